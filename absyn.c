@@ -7,91 +7,183 @@
 #include <unistd.h>
 
 #include "absyn.h"
+#include "arith.h"
+#include "common.h"
 #include "memory.h"
 
+#define AST_ARENA_CHUNK_SIZE (64 * 1024)
+#define INTERN_INITIAL_SIZE 1024
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static Arena *ast_arena = NULL;
+
+static struct InternTable {
+  ASTBuffer **slots;
+  size_t capacity;
+  size_t count;
+} intern_table = {NULL, 0, 0};
+
+void *ast_arena_alloc(size_t size) {
+  if (ast_arena == NULL)
+    ast_arena = new_arena(AST_ARENA_CHUNK_SIZE);
+  return arena_alloc(ast_arena, size);
+}
+
+void ast_arena_reset(void) {
+  if (ast_arena != NULL)
+    arena_reset(ast_arena);
+
+  /* Interned buffers live in the AST arena, so the table is per parse. */
+  if (intern_table.count) {
+    memset(intern_table.slots, 0, intern_table.capacity * sizeof(ASTBuffer *));
+    intern_table.count = 0;
+  }
+  reset_current_buffers();
+}
+
 ASTBuffer *new_ast_buffer(uint8_t *buffer, size_t length) {
-  ASTBuffer *buffer = gc_alloc(sizeof(ASTBuffer));
-  gc_incref(buffer);
-  buffer->buffer = gc_strndup(buffer, length);
-  buffer->length = length;
-  buffer->next = NULL;
-  return buffer;
+  ASTBuffer *astbuffer = ast_arena_alloc(sizeof(ASTBuffer));
+  astbuffer->buffer = arena_strndup(ast_arena, buffer, length);
+  astbuffer->length = length;
+  astbuffer->capacity = length + 1;
+  astbuffer->hash = 0;
+  astbuffer->interned = false;
+  astbuffer->next = NULL;
+  astbuffer->tail = astbuffer;
+  return astbuffer;
 }
 
 ASTBuffer *new_ast_buffer_blank(void) {
-  ASTBuffer *buffer = gc_alloc(sizeof(ASTBuffer));
-  gc_incref(buffer);
-  buffer->buffer = gc_alloc(1);
-  gc_incref(buffer->buffer);
+  ASTBuffer *buffer = ast_arena_alloc(sizeof(ASTBuffer));
+  buffer->buffer = ast_arena_alloc(1);
+  buffer->buffer[0] = '\0';
   buffer->length = 0;
+  buffer->capacity = 1;
+  buffer->hash = 0;
+  buffer->interned = false;
+  buffer->next = NULL;
+  buffer->tail = buffer;
   return buffer;
 }
 
+static uint32_t hash_bytes(const uint8_t *bytes, size_t length) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static void intern_table_grow(void) {
+  size_t capacity =
+      intern_table.capacity ? intern_table.capacity * 2 : INTERN_INITIAL_SIZE;
+  ASTBuffer **slots = calloc(capacity, sizeof(ASTBuffer *));
+
+  if (slots == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < intern_table.capacity; i++) {
+    ASTBuffer *buffer = intern_table.slots[i];
+    if (buffer == NULL)
+      continue;
+    size_t slot = buffer->hash & (capacity - 1);
+    while (slots[slot] != NULL)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = buffer;
+  }
+
+  free(intern_table.slots);
+  intern_table.slots = slots;
+  intern_table.capacity = capacity;
+}
+
+ASTBuffer *ast_buffer_intern(const uint8_t *buffer, size_t length) {
+  if ((intern_table.count + 1) * 10 > intern_table.capacity * 7)
+    intern_table_grow();
+
+  uint32_t hash = hash_bytes(buffer, length);
+  size_t slot = hash & (intern_table.capacity - 1);
+  ASTBuffer *entry;
+
+  while ((entry = intern_table.slots[slot]) != NULL) {
+    if (entry->hash == hash && entry->length == length &&
+        !memcmp(entry->buffer, buffer, length))
+      return entry;
+    slot = (slot + 1) & (intern_table.capacity - 1);
+  }
+
+  entry = ast_arena_alloc(sizeof(ASTBuffer));
+  entry->buffer = arena_strndup(ast_arena, buffer, length);
+  entry->length = length;
+  entry->capacity = length + 1;
+  entry->hash = hash;
+  entry->interned = true;
+  entry->next = NULL;
+  entry->tail = entry;
+  intern_table.slots[slot] = entry;
+  intern_table.count++;
+  return entry;
+}
+
+bool ast_buffer_equals(ASTBuffer *buffer, const uint8_t *string,
+                       size_t length) {
+  return buffer->length == length && !memcmp(buffer->buffer, string, length);
+}
+
 bool ast_buffer_compare_string(ASTBuffer *buffer, const uint8_t *against) {
-  if (!strncmp(buffer->buffer, against, buffer->length))
+  if (!strncmp((char *)buffer->buffer, (char *)against, buffer->length))
     return true;
   return false;
 }
 
 bool ast_buffer_compare_buffer(ASTBuffer *buffer, ASTBuffer *against) {
-  return ast_buffer_compare_string(buffer, against->buffer);
+  if (buffer->interned && against->interned)
+    return buffer == against;
+  return ast_buffer_equals(buffer, against->buffer, against->length);
 }
 
-void ast_buffer_append_char(ASTBuffer *buffer, uint8_t ch) {
-  buffer->buffer = gc_realloc(buffer->buffer, ++buffer->length);
-  buffer->buffer[buffer->length - 1] = ch;
-}
+void ast_buffer_reserve(ASTBuffer *buffer, size_t extra) {
+  assert(!buffer->interned);
+  size_t needed = buffer->length + extra + 1;
+  if (needed <= buffer->capacity)
+    return;
 
-void ast_buffer_append_string(ASTBuffer *buffer, uint8_t *string, size_t length) {
-  buffer->buffer = gc_realloc(buffer->buffer, buffer->length + length + 1);
-  memmove(&buffer->buffer[buffer->length - 1], &string[0], length);
-  buffer->length += length;
+  size_t capacity = buffer->capacity * 2;
+  if (capacity < needed)
+    capacity = needed;
+  buffer->buffer =
+      arena_realloc(ast_arena, buffer->buffer, buffer->capacity, capacity);
+  buffer->capacity = capacity;
 }
 
-void delete_ast_buffer(ASTBuffer *buffer) {
-  gc_free((void *)buffer->buffer);
-  gc_decref(buffer);
+void ast_buffer_append_char(ASTBuffer *buffer, uint8_t ch) {
+  ast_buffer_reserve(buffer, 1);
+  buffer->buffer[buffer->length++] = ch;
+  buffer->buffer[buffer->length] = '\0';
 }
 
-void delete_ast_buffer_chain(ASTBuffer *head) {
-  ASTBuffer *tmp = head;
-  while (tmp) {
-    ASTBuffer *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_buffer(to_free);
-  }
+void ast_buffer_append_string(ASTBuffer *buffer, uint8_t *string,
+                              size_t length) {
+  ast_buffer_reserve(buffer, length);
+  memcpy(&buffer->buffer[buffer->length], &string[0], length);
+  buffer->length += length;
+  buffer->buffer[buffer->length] = '\0';
 }
 
 ASTBuffer *ast_digit_to_buffer(long digit) {
-  switch (digit) {
-  case 0:
-    return new_ast_buffer("0", 1);
-  case 1:
-    return new_ast_buffer("1", 1);
-  case 2:
-    return new_ast_buffer("2", 1);
-  case 3:
-    return new_ast_buffer("3", 1);
-  case 4:
-    return new_ast_buffer("4", 1);
-  case 5:
-    return new_ast_buffer("5", 1);
-  case 6:
-    return new_ast_buffer("6", 1);
-  case 7:
-    return new_ast_buffer("7", 1);
-  case 8:
-    return new_ast_buffer("8", 1);
-  case 9:
-    return new_ast_buffer("9", 1);
-  default:
-    break;
-  }
+  if (digit < 0 || digit > 9)
+    return NULL;
+
+  uint8_t ch = '0' + digit;
+  return ast_buffer_intern(&ch, 1);
 }
 
 ASTParam *new_ast_param(enum ParamKind kind, void *hook) {
-  ASTParam *param = gc_alloc(sizeof(ASTParam));
-  gc_incref(param);
+  ASTParam *param = ast_arena_alloc(sizeof(ASTParam));
   param->kind = kind;
 
   if (kind == PARAM_Positional)
@@ -99,564 +191,349 @@ ASTParam *new_ast_param(enum ParamKind kind, void *hook) {
   else if (kind == PARAM_Special)
     param->v_special = *((char *)hook);
   else if (kind == PARAM_ShellVariable)
-    param->v_variable = gc_incref(hook);
+    param->v_variable = hook;
 
   return param;
 }
 
-void delete_ast_param(ASTParam *param) {
-  if (param->kind == PARAM_ShellVariable)
-    gc_decref(param->v_varaible);
-  gc_decref(param);
-}
-
 ASTWordExpn *new_ast_wordexpn(enum WordExpnKind kind, void *hook) {
-  ASTWordExpn *wordexpn = gc_alloc(sizeof(ASTWordExpn));
-  gc_incref(wordexpn);
+  ASTWordExpn *wordexpn = ast_arena_alloc(sizeof(ASTWordExpn));
   wordexpn->kind = kind;
   wordexpn->next = NULL;
+  wordexpn->tail = wordexpn;
 
   if (kind == WEXPN_ParamExpn)
-    wordexpn->v_paramexpn = gc_incref(hook);
+    wordexpn->v_paramexpn = hook;
   else if (kind == WEXPN_Text)
-    wordexpn->v_buffer = gc_incref(hook);
+    wordexpn->v_buffer = hook;
   else if (kind == WEXPN_CommandSubst)
-    wordexpn->v_compound = gc_incref(hook);
+    wordexpn->v_compound = hook;
   else if (kind == WEXPN_ArithExpr)
-    wordexpn->v_arithexpr = gc_incref(hook);
+    wordexpn->v_arithexpr = hook;
   else if (kind == WEXPN_Pattern)
-    wordexpn->v_pattern = gc_incref(hook);
+    wordexpn->v_pattern = hook;
 
   return wordexpn;
 }
 
 void ast_wordexpn_append(ASTWordExpn *head, ASTWordExpn *new_wordexpn) {
-  ASTWordExpn *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_wordexpn);
-}
-
-void delete_ast_wordexpn(ASTWordExpn *wordexpn) {
-  if (wordexpn->kind == WEXPN_ParamExpn)
-    delete_ast_paramexpn(wordexpn->v_paramexpn);
-  else if (wordexpn->kind == WEXPN_Text)
-    delete_ast_buffer(wordexpn->v_buffer);
-  else if (wordexpn->kind == WEXPN_CommandSubst)
-    delete_ast_compound(wordexpn->v_buffer);
-  else if (wordexpn->kind == WEXPN_Pattern)
-    delete_ast_pattern(wordexpn->v_pattern);
-  else if (wordexpn->kind == WEXPN_ArithExpr)
-    delete_ast_arithexpr(wordexpn->v_arithexpr);
-  gc_decref(wordexpn);
-}
-
-void delete_ast_wordexpn_chain(ASTWordExpn *head) {
-  ASTWordExpn *tmp = head;
-  while (tmp) {
-    ASTWordExpn *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_wordexpn(to_free);
-  }
+  head->tail->next = new_wordexpn;
+  head->tail = new_wordexpn->tail;
 }
 
 ASTParamExpn *new_ast_paramexpn(ASTParam *param, ASTBuffer *punct,
                                 ASTWord *word) {
-  ASTParamExpn *paramexpn = gc_alloc(sizeof(ASTParamExpn));
-  gc_incref(paramexpn);
-  paramexpn->param = gc_incref(param);
-  paramexpn->punct = gc_incref(punct);
-  paramexpn->word = gc_incref(word);
+  ASTParamExpn *paramexpn = ast_arena_alloc(sizeof(ASTParamExpn));
+  paramexpn->param = param;
+  paramexpn->punct = punct;
+  paramexpn->word = word;
   return paramexpn;
 }
 
-void delete_ast_paramexpn(ASTParamExpn *paramexpn) {
-  gc_decref(paramexpn->param);
-  gc_decref(paramexpn->punct);
-  gc_decref(paramexpn->word);
-  gc_decref(paramexpn);
-}
-
 ASTSimpleCommand *new_ast_simple_command(ASTBuffer *prefix, ASTWord *argv0) {
-  ASTSimpleCommand *simplecmd = gc_alloc(sizeof(ASTSimpleCommand));
-  gc_incref(simplecmd);
+  ASTSimpleCommand *simplecmd = ast_arena_alloc(sizeof(ASTSimpleCommand));
   simplecmd->prefix = prefix;
   simplecmd->redir = NULL;
   simplecmd->argv = argv0;
   simplecmd->nargs = 1;
   simplecmd->next = NULL;
+  simplecmd->tail = simplecmd;
   return simplecmd;
 }
 
 void ast_simple_command_append(ASTSimpleCommand *head,
                                ASTSimpleCommand *new_command) {
-  ASTSimpleCommand *tmp = head;
-  while (head->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_command);
-}
-
-void delete_ast_simple_command(ASTSimpleCommand *simplecmd) {
-  if (simplecmd->redir != NULL)
-    delete_ast_redir(simplecmd->redir);
-  if (simplemcd->prefix != NULL)
-    delete_ast_buffer(simplecmd->buffer);
-  delete_ast_word_chain(simplecmd->argv);
-  gc_decref(simplecmd);
-}
-
-void delete_ast_simple_command_chain(ASTSimpleCommand *head) {
-  ASTSimpleCommand *tmp = head;
-  while (tmp) {
-    ASTSimpleCommand *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_simple_command(to_free);
-  }
+  head->tail->next = new_command;
+  head->tail = new_command->tail;
 }
 
 void ast_buffer_append(ASTBuffer *buffer, ASTBuffer *new_buffer) {
-  ASTBuffer *tmp = buffer;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref((void *)new_buffer);
+  assert(!buffer->interned);
+
+  if (new_buffer->interned) {
+    ASTBuffer *view = ast_arena_alloc(sizeof(ASTBuffer));
+    *view = *new_buffer;
+    view->interned = false;
+    view->tail = view;
+    new_buffer = view;
+  }
+
+  buffer->tail->next = new_buffer;
+  buffer->tail = new_buffer->tail;
 }
 
 ASTRedir *new_ast_redir(enum RedirKind kind, ASTBuffer *subj) {
-  ASTRedir *redir = gc_alloc(sizeof(ASTRedir));
-  gc_incref(redir);
+  ASTRedir *redir = ast_arena_alloc(sizeof(ASTRedir));
   redir->kind = kind;
   redir->fno = -1;
-  redir->subj = gc_incref(subj);
+  redir->subj = subj;
   return redir;
 }
 
-void delete_ast_redir(ASTRedir *redir) {
-  gc_decref(redir->subj);
-  gc_decref(redir);
-}
-
 ASTWord *new_ast_word(enum WordKind kind, void *new_word) {
-  ASTWord *word = gc_alloc(sizeof(ASTWord));
-  gc_incref(word);
+  ASTWord *word = ast_arena_alloc(sizeof(ASTWord));
   word->kind = kind;
   word->next = NULL;
+  word->tail = word;
 
   if (kind == WORD_Buffer || kind == WORD_QString)
-    word->v_buffer = gc_incref(new_word);
+    word->v_buffer = new_word;
   else if (kind == WORD_Redir)
-    word->v_redir = gc_incref(new_word);
+    word->v_redir = new_word;
   else if (kind == WORD_WordExpn || kind == WORD_String)
-    word->v_wordexpn = gc_incref(new_word);
+    word->v_wordexpn = new_word;
+  else if (kind == WORD_Pattern)
+    word->v_pattern = new_word;
+  else if (kind == WORD_Assign)
+    word->v_assign = new_word;
+
+  return word;
+}
+
+ASTAssign *new_ast_assign(ASTBuffer *name, ASTWord *value) {
+  ASTAssign *assign = ast_arena_alloc(sizeof(ASTAssign));
+  assign->name = name;
+  assign->value = value;
+  return assign;
 }
 
 void ast_word_append(ASTWord *head, ASTWord *new_word) {
-  ASTWord *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = new_word;
-}
-
-void delete_ast_word(ASTWord *word) {
-  if (word->kind == WORD_Buffer)
-    delete_ast_buffer(word->v_buffer);
-  else if (word->kind == WORD_Redir)
-    delete_ast_redir(word->v_redir);
-  else if (word->kind == WORD_String || word->kind == WORD_WordExpn)
-    delete_ast_wordexpn(word->v_wordexpn);
-  else if (word->kind == WORD_Assign)
-    delete_ast_assign(word->v_assign);
-  else if (word->kind == WORD_Pattern)
-    delete_ast_pattern(word->v_pattern);
-  gc_decref(word);
-}
-
-void delete_ast_word_chain(ASTWord *head) {
-  ASTWord *tmp = head;
-  while (tmp) {
-    ASTWord *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_word(to_free);
-  }
+  head->tail->next = new_word;
+  head->tail = new_word->tail;
 }
 
 ASTPipeline *new_ast_pipeline(ASTSimpleCommand *head) {
-  ASTPipeline *pipeline = gc_alloc(sizeof(ASTPipeline));
-  gc_incref(pipeline);
+  ASTPipeline *pipeline = ast_arena_alloc(sizeof(ASTPipeline));
   pipeline->sep = SEP_None;
   pipeline->term = TERM_None;
-  pipeline->commands = gc_incref(head);
+  pipeline->commands = head;
   pipeline->ncommands = 1;
   pipeline->next = NULL;
+  pipeline->tail = pipeline;
   return pipeline;
 }
 
 void ast_pipeline_append(ASTPipeline *head, ASTPipeline *new_pipeline) {
-  ASTPipeline *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_pipeline);
-}
-
-void delete_ast_pipeline(ASTPipeline *pipeline) {
-  delete_ast_simple_command_chain(pipeline->commands);
-  gc_decref(pipeline);
-}
-
-void delete_ast_pipeline_chain(ASTPipeline *head) {
-  ASTPipeline *tmp = head;
-  while (tmp) {
-    ASTPipeline *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_pipeline(to_free);
-  }
+  head->tail->next = new_pipeline;
+  head->tail = new_pipeline->tail;
 }
 
 ASTList *new_ast_list(ASTPipeline *head) {
-  ASTList *list = gc_alloc(sizeof(ASTList));
-  gc_incref(list);
-  list->commands = gc_incref(head);
+  ASTList *list = ast_arena_alloc(sizeof(ASTList));
+  list->commands = head;
   list->ncommands = 1;
+  list->next = NULL;
+  list->tail = list;
+  return list;
 }
 
 void ast_list_append(ASTList *head, ASTList *new_list) {
-  ASTList *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_list);
-}
-
-void delete_ast_list(ASTList *list) {
-  delete_ast_compound_chain(list->commands);
-  gc_decref(list);
-}
-
-void delete_ast_list_chain(ASTList *head) {
-  ASTList *tmp = head;
-  while (tmp) {
-    ASTList *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_list(to_free);
-  }
+  head->tail->next = new_list;
+  head->tail = new_list->tail;
 }
 
 ASTCompound *new_ast_compound(enum CompoundKind kind, void *hook) {
-  ASTCompound *compound = gc_alloc(sizeof(ASTCompound));
-  gc_incref(compound);
+  ASTCompound *compound = ast_arena_alloc(sizeof(ASTCompound));
   compound->next = NULL;
+  compound->tail = compound;
   compound->kind = kind;
 
   if (kind == COMPOUND_List)
-    compound->v_list = gc_incref(hook);
+    compound->v_list = hook;
   else if (kind == COMPOUND_SimpleCommand)
-    compound->v_simplecmd = gc_incref(hook);
+    compound->v_simplecmd = hook;
   else if (kind == COMPOUND_Subshell || kind == COMPOUND_Group)
-    compound->v_compoundlist = gc_incref(hook);
+    compound->v_compoundlist = hook;
   else if (kind == COMPOUND_Pipeline)
-    compound->v_pipeline = gc_incref(hook);
+    compound->v_pipeline = hook;
   else if (kind == COMPOUND_ForLoop)
-    compound->v_forloop = gc_incref(hook);
+    compound->v_forloop = hook;
   else if (kind == COMPOUND_WhileLoop)
-    compound->v_whileloop = gc_incref(hook);
+    compound->v_whileloop = hook;
   else if (kind == COMPOUND_UntilLoop)
-    compound->v_untilloop = gc_incref(hook);
+    compound->v_untilloop = hook;
   else if (kind == COMPOUND_IfCond)
-    compound->v_ifcond = gc_incref(hook);
+    compound->v_ifcond = hook;
   else if (kind == COMPOUND_CaseCond)
-    compound->v_casecond = gc_incref(hook);
+    compound->v_casecond = hook;
+
+  return compound;
 }
 
 void ast_compound_append(ASTCompound *head, ASTCompound *new_compound) {
-  ASTCompound *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_compound);
-}
-
-void delete_ast_compound(ASTCompound *compound) {
-  if (compound->kind == COMPOUND_List)
-    delete_ast_list_chain(compound->v_list);
-  else if (compound->kind == COMPOUND_SimpleCommand)
-    delete_ast_simple_command(compound->v_simplecmd);
-  else if (compound->kind == COMPOUND_Subshell ||
-           compound->kind == COMPOUND_Group)
-    delete_ast_compoundlist(compound->v_compoundlist);
-  else if (compound->kind == COMPOUND_Pipeline)
-    delete_ast_pipeline_chain(compound->v_pipeline);
-  else if (compound->kind == COMPOUND_WhileLoop)
-    delete_ast_whileloop(compound->v_whileloop);
-  else if (compound->kind == COMPOUND_UntilLoop)
-    delete_ast_untilloop(compound->v_untilloop);
-  else if (compound->kind == COMPOUND_ForLoop)
-    delete_ast_forloop(compound->v_forloop);
-  else if (compound->kind == COMPOUND_CaseCond)
-    delete_ast_casecond(compound->v_casecond);
-  else if (compound->kind == COMPOUND_IfCond)
-    delete_ast_ifcond(compound->v_ifcond);
-  gc_decref(compound);
-}
-
-void delete_ast_compound_chain(ASTCompound *head) {
-  ASTCompound *tmp = head;
-  while (tmp) {
-    ASTCompound *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_compound(to_free);
-  }
+  head->tail->next = new_compound;
+  head->tail = new_compound->tail;
 }
 
 ASTWhileLoop *new_ast_whileloop(ASTCompoundList *cond, ASTCompoundList *body) {
-  ASTWhileLoop *whileloop = gc_alloc(sizeof(ASTWhileLoop));
-  gc_incref(whileloop);
-  whileloop->cond = gc_incref(cond);
-  whileloop->body = gc_incref(body);
+  ASTWhileLoop *whileloop = ast_arena_alloc(sizeof(ASTWhileLoop));
+  whileloop->cond = cond;
+  whileloop->body = body;
   return whileloop;
 }
 
 ASTUntilLoop *new_ast_untilloop(ASTCompoundList *cond, ASTCompoundList *body) {
-  ASTUntilLoop *untilloop = gc_alloc(sizeof(ASTUntilLoop));
-  gc_incref(untilloop);
-  untilloop->cond = gc_incref(cond);
-  untilloop->body = gc_incref(body);
+  ASTUntilLoop *untilloop = ast_arena_alloc(sizeof(ASTUntilLoop));
+  untilloop->cond = cond;
+  untilloop->body = body;
   return untilloop;
 }
 
 ASTForLoop *new_ast_forloop(ASTBuffer *buffer, ASTBuffer *iter,
                             ASTCompoundList *body) {
-  ASTForLoop *forloop = gc_alloc(sizeof(ASTForLoop));
-  gc_incref(forloop);
-  forloop->name = gc_incref(buffer);
-  forloop->iter = gc_incref(iter);
-  forloop->body = gc_incref(body);
+  ASTForLoop *forloop = ast_arena_alloc(sizeof(ASTForLoop));
+  forloop->name = buffer;
+  forloop->iter = iter;
+  forloop->body = body;
   return forloop;
 }
 
-ASTCaseCond *new_ast_casecond(ASTBuffer *discrim) {
-  ASTCaseCond *casecond = gc_alloc(sizeof(ASTCaseCond));
-  gc_incref(casecond);
-  casecond->discrim = gc_incref(discrim);
+ASTCaseCond *new_ast_casecond(ASTWord *discrim) {
+  ASTCaseCond *casecond = ast_arena_alloc(sizeof(ASTCaseCond));
+  casecond->discrim = discrim;
   casecond->pairs = NULL;
+  casecond->pairs_tail = NULL;
   return casecond;
 }
 
 ASTIfCond *new_ast_ifcond(void) {
-  ASTIfCond *ifcond = gc_alloc(sizeof(ASTIfCond));
-  gc_incref(ifcond);
+  ASTIfCond *ifcond = ast_arena_alloc(sizeof(ASTIfCond));
   ifcond->pairs = NULL;
+  ifcond->pairs_tail = NULL;
   ifcond->else_body = NULL;
   return ifcond;
 }
 
-void delete_ast_whileloop(ASTWhileLoop *whileloop) {
-  delete_ast_compound_list(whileloop->cond);
-  delete_ast_compound_list(whileloop->body);
-  gc_decref(whileloop);
-}
-
-void delete_ast_untilloop(ASTUntilLoop *untilloop) {
-  delete_ast_compound_list(untilloop->cond);
-  delete_ast_compound_list(untilloop->body);
-  gc_decref(untilloop);
-}
-
-void delete_ast_forloop(ASTForLoop *forloop) {
-  delete_ast_buffer(forloop->name);
-  delete_ast_buffer_chain(forloop->iter);
-  delete_ast_compound_list(forloop->body);
-  gc_decref(forloop);
-}
-
-void delete_ast_casecond(ASTCaseCond *casecond) {
-  delete_ast_buffer(casecond->discrim);
-  struct ASTCasePair *tmp = casecond->pairs;
-  while (tmp) {
-    struct ASTCasePair *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_pattern_chain(to_free->clauses);
-    delete_ast_compound_list(to_free->body);
-    gc_decref(to_free);
-  }
-  gc_decref(casecond);
-}
-
-void delete_ast_ifcond(ASTIfCond *ifcond) {
-  struct ASTIfPair *tmp = ifcond->pairs;
-  while (tmp) {
-    struct ASTIfPair *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_compound_list(to_free->cond);
-    delete_ast_compound_list(to_free->body);
-    gc_decref(to_free);
-  }
-  if (ifcond->else_body != NULL)
-    delete_ast_compound_list(ifcond->else_body);
-  gc_decref(ifcond);
-}
 void ast_casecond_pair_append(ASTCaseCond *casecond, ASTPattern *clauses,
                               ASTCompoundList *body) {
-  struct ASTCasePair *tmp = casecond->pairs;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_alloc(sizeof(struct ASTCasePair));
-  tmp->next->clauses = gc_incref(clauses);
-  tmp->next->body = gc_incref(body);
-  tmp->next->next = NULL;
-  gc_incref(tmp->next);
+  struct ASTCasePair *pair = ast_arena_alloc(sizeof(struct ASTCasePair));
+  pair->clauses = clauses;
+  pair->body = body;
+  pair->next = NULL;
+
+  if (casecond->pairs_tail != NULL)
+    casecond->pairs_tail->next = pair;
+  else
+    casecond->pairs = pair;
+  casecond->pairs_tail = pair;
 }
 
 void ast_ifcond_pair_append(ASTIfCond *ifcond, ASTCompoundList *cond,
                             ASTCompoundList *body) {
-  struct ASTIfPair *tmp = ifcond->pairs;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_alloc(sizeof(struct ASTIfPair));
-  tmp->next->cond = gc_incref(cond);
-  tmp->next->body = gc_incref(body);
-  tmp->next->next = NULL;
-  gc_incref(tmp->next);
-}
-
-ASTPattern *new_ast_pattern(enum PatternKind kind, ASTBracket *bracket) {
-  ASTPattern *pattern = gc_alloc(sizeof(ASTPattern));
-  gc_incref(pattern);
+  struct ASTIfPair *pair = ast_arena_alloc(sizeof(struct ASTIfPair));
+  pair->cond = cond;
+  pair->body = body;
+  pair->next = NULL;
+
+  if (ifcond->pairs_tail != NULL)
+    ifcond->pairs_tail->next = pair;
+  else
+    ifcond->pairs = pair;
+  ifcond->pairs_tail = pair;
+}
+
+ASTPattern *new_ast_pattern(enum PatternKind kind, void *hook) {
+  ASTPattern *pattern = ast_arena_alloc(sizeof(ASTPattern));
   pattern->kind = kind;
-  pattern->bracket = gc_incref(bracket);
+
+  if (kind == PATT_Bracket)
+    pattern->v_bracket = hook;
+  else if (kind == PATT_Literal)
+    pattern->v_literal = hook;
+
+  pattern->glob = NULL;
   pattern->next = NULL;
+  pattern->tail = pattern;
+  pattern->alternative = NULL;
   return pattern;
 }
 
 void ast_pattern_append(ASTPattern *head, ASTPattern *new_pattern) {
-  ASTPattern *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_pattern);
+  head->tail->next = new_pattern;
+  head->tail = new_pattern->tail;
 }
 
-void delete_ast_pattern(ASTPattern *pattern) {
-  gc_decref(pattern->bracket);
-  gc_decref(pattern);
-}
-
-void delete_ast_pattern_chain(ASTPattern *head) {
-  ASTPattern *tmp = head;
-  while (tmp) {
-    ASTPattern *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_pattern(tmp);
-  }
+void ast_pattern_alternate(ASTPattern *head, ASTPattern *alternative) {
+  while (head->alternative)
+    head = head->alternative;
+  head->alternative = alternative;
 }
 
 ASTCharRange *new_ast_charrange(char start, char end) {
-  ASTCharRange *charrange = gc_alloc(sizeof(ASTCharRange));
-  gc_incref(charrange);
+  ASTCharRange *charrange = ast_arena_alloc(sizeof(ASTCharRange));
   charrange->start = start;
   charrange->end = end;
   charrange->next = NULL;
+  charrange->tail = charrange;
   return charrange;
 }
 
 void ast_charrange_append(ASTCharRange *head, ASTCharRange *new_charrange) {
-  ASTCharRange *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_charrange);
-}
-
-void delete_ast_charrange(ASTCharRange *charrange) { gc_decref(charrange); }
-void delete_ast_charrange_chain(ASTCharRange *head) {
-  ASTCharRange *tmp = head;
-  while (tmp) {
-    ASTCharRange *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_charrange(to_free);
-  }
+  head->tail->next = new_charrange;
+  head->tail = new_charrange->tail;
 }
+
 ASTBracket *new_ast_bracket(ASTCharRange *ranges, bool negate) {
-  ASTBracket *bracket = gc_alloc(sizeof(ASTBracket));
-  gc_incref(bracket);
+  ASTBracket *bracket = ast_arena_alloc(sizeof(ASTBracket));
   bracket->ranges = ranges;
   bracket->negate = negate;
   return bracket;
 }
 
-void delete_ast_bracket(ASTBracket *bracket) {
-  delete_ast_charrange_chain(bracket->ranges);
-  gc_decref(bracket);
-}
-
 ASTFuncDef *new_ast_funcdef(ASTBuffer *name, ASTCompound *body,
                             ASTRedir *redir) {
-  ASTFuncDef *funcdef = gc_alloc(sizeof(ASTFuncDef));
-  gc_incref(funcdef);
-  funcdef->name = gc_incref(name);
-  funcdef->body = gc_incref(body);
-  funcdef->redir = gc_incref(redir);
+  ASTFuncDef *funcdef = ast_arena_alloc(sizeof(ASTFuncDef));
+  funcdef->name = name;
+  funcdef->body = body;
+  funcdef->redir = redir;
   return funcdef;
 }
 
-void delete_ast_funcdef(ASTFuncDef *funcdef) {
-  gc_decref(funcdef->name);
-  gc_decref(funcdef->body);
-  gc_decref(funcdef->redir);
-}
-
 ASTCompoundList *new_ast_compound_list(ASTList *head) {
-  ASTCompoundList *compoundlist = gc_alloc(sizeof(ASTCompoundList));
+  ASTCompoundList *compoundlist = ast_arena_alloc(sizeof(ASTCompoundList));
   compoundlist->lists = head;
   compoundlist->nlists = 1;
   return compoundlist;
 }
 
-void delete_ast_compound_list(ASTCompoundList *compoundlist) {
-  delete_ast_list_chain(compoundlist->lists);
-  gc_decref(compoundlist);
-}
-
 ASTFactor *new_ast_factor(enum FactorKind kind, void *hook) {
-  ASTFactor *factor = gc_alloc(sizeof(ASTFactor));
+  ASTFactor *factor = ast_arena_alloc(sizeof(ASTFactor));
   factor->next = NULL;
+  factor->tail = factor;
   factor->kind = kind;
 
-  if (kind == FACT_Number)
+  if (kind == FACT_Number) {
     factor->v_number = *((intmax_t *)hook);
-  else if (kind == FACT_ArithExpr)
-    factor->v_arithexpr = hook;
+  } else if (kind == FACT_Variable) {
+    factor->v_variable = hook;
+  } else if (kind == FACT_ArithExpr) {
+    ASTArithExpr *expr = hook;
+    intmax_t value;
+
+    /* Fold as the parser reduces so literal subtrees never reach the VM. */
+    if (expr->left->kind == FACT_Number && expr->right->kind == FACT_Number &&
+        arith_apply(expr->op, expr->left->v_number, expr->right->v_number,
+                    &value)) {
+      factor->kind = FACT_Number;
+      factor->v_number = value;
+    } else {
+      factor->v_arithexpr = expr;
+    }
+  }
 
   return factor;
 }
 
 void ast_factor_append(ASTFactor *head, ASTFactor *new_factor) {
-  ASTFactor *tmp = head;
-  while (tmp->next != NULL)
-    tmp = tmp->next;
-  tmp->next = gc_incref(new_factor);
-}
-
-void delete_ast_factor(ASTFactor *factor) {
-  if (factor->kind == FACT_ArithExpr)
-    delete_ast_arithexpr(factor->v_arithexpr);
-  gc_decref(factor);
-}
-
-void delete_ast_factor_chain(ASTFactor *head) {
-  ASTFactor *tmp = head;
-  while (tmp) {
-    ASTFactor *to_free = tmp;
-    tmp = tmp->next;
-    delete_ast_factor(to_free);
-  }
+  head->tail->next = new_factor;
+  head->tail = new_factor->tail;
 }
 
 ASTArithExpr *new_ast_arithexpr(enum OperatorKind op, ASTFactor *left,
                                 ASTFactor *right) {
-  ASTArithExpr *arithexpr = gc_alloc(sizeof(ASTArithExpr));
+  ASTArithExpr *arithexpr = ast_arena_alloc(sizeof(ASTArithExpr));
   arithexpr->op = op;
-  arithexpr->left = gc_incref(left);
-  arithexpr->right = gc_incref(right);
+  arithexpr->left = left;
+  arithexpr->right = right;
   return arithexpr;
 }
-
-void delete_ast_arithexpr(ASTArithExpr *arithexpr) {
-  delete_ast_factor_chain(arithexpr->left);
-  delete_ast_factor_chain(arithexpr->right);
-  gc_decref(arithexpr);
-}
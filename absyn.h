@@ -1,6 +1,7 @@
 #ifndef ABSYN_H
 #define ABSYN_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +9,7 @@
 typedef struct ASTBuffer ASTBuffer;
 typedef struct ASTParam ASTParam;
 typedef struct ASTWordExpn ASTWordExpn;
+typedef struct ASTParamExpn ASTParamExpn;
 typedef struct ASTHereDoc ASTHereDoc;
 typedef struct ASTRedir ASTRedir;
 typedef struct ASTWord ASTWord;
@@ -28,11 +30,16 @@ typedef struct ASTPattern ASTPattern;
 typedef struct ASTFuncDef ASTFuncDef;
 typedef struct ASTFactor ASTFactor;
 typedef struct ASTArithExpr ASTArithExpr;
+typedef struct ASTAssign ASTAssign;
 
 struct ASTBuffer {
   uint8_t *buffer;
   size_t length;
+  size_t capacity;
+  uint32_t hash;
+  bool interned;
   ASTBuffer *next;
+  ASTBuffer *tail;
 };
 
 struct ASTParam {
@@ -53,11 +60,12 @@ struct ASTCharRange {
   char start;
   char end;
   ASTCharRange *next;
+  ASTCharRange *tail;
 };
 
 struct ASTBracket {
   ASTCharRange *ranges;
-  bool nranges;
+  bool negate;
 };
 
 struct ASTPattern {
@@ -65,10 +73,18 @@ struct ASTPattern {
     PATT_AnyString,
     PATT_AnyChar,
     PATT_Bracket,
+    PATT_Literal,
   } kind;
 
-  ASTBracket *bracket;
+  union {
+    ASTBracket *v_bracket;
+    ASTBuffer *v_literal;
+  };
+
+  const uint8_t *glob;
   ASTPattern *next;
+  ASTPattern *tail;
+  ASTPattern *alternative;
 };
 
 struct ASTWordExpn {
@@ -90,6 +106,7 @@ struct ASTWordExpn {
   };
 
   ASTWordExpn *next;
+  ASTWordExpn *tail;
 };
 
 struct ASTParamExpn {
@@ -117,7 +134,7 @@ struct ASTRedir {
     REDIR_NoClobber,
   } kind;
 
-  ASTRedir *subj;
+  ASTBuffer *subj;
   int fno;
 };
 
@@ -128,15 +145,25 @@ struct ASTWord {
     WORD_WordExpn,
     WORD_QString,
     WORD_String,
+    WORD_Pattern,
+    WORD_Assign,
   } kind;
 
   union {
     ASTBuffer *v_buffer;
     ASTRedir *v_redir;
     ASTWordExpn *v_wordexpn;
+    ASTPattern *v_pattern;
+    ASTAssign *v_assign;
   };
 
   ASTWord *next;
+  ASTWord *tail;
+};
+
+struct ASTAssign {
+  ASTBuffer *name;
+  ASTWord *value;
 };
 
 struct ASTSimpleCommand {
@@ -145,6 +172,7 @@ struct ASTSimpleCommand {
   size_t nargs;
   ASTRedir *redir;
   ASTSimpleCommand *next;
+  ASTSimpleCommand *tail;
 };
 
 struct ASTPipeline {
@@ -164,12 +192,14 @@ struct ASTPipeline {
   ASTSimpleCommand *commands;
   size_t ncommands;
   ASTPipeline *next;
+  ASTPipeline *tail;
 };
 
 struct ASTList {
-  ASTCompound *commands;
+  ASTPipeline *commands;
   size_t ncommands;
   ASTList *next;
+  ASTList *tail;
 };
 
 struct ASTCompoundList {
@@ -194,12 +224,13 @@ struct ASTForLoop {
 };
 
 struct ASTCaseCond {
-  ASTBuffer *discrim;
+  ASTWord *discrim;
   struct ASTCasePair {
     ASTPattern *clauses;
     ASTCompoundList *body;
     struct ASTCasePair *next;
   } *pairs;
+  struct ASTCasePair *pairs_tail;
 };
 
 struct ASTIfCond {
@@ -208,6 +239,7 @@ struct ASTIfCond {
     ASTCompoundList *body;
     struct ASTIfPair *next;
   } *pairs;
+  struct ASTIfPair *pairs_tail;
   ASTCompoundList *else_body;
 };
 
@@ -238,6 +270,7 @@ struct ASTCompound {
   };
 
   ASTCompound *next;
+  ASTCompound *tail;
 };
 
 struct ASTFuncDef {
@@ -249,15 +282,18 @@ struct ASTFuncDef {
 struct ASTFactor {
   enum FactorKind {
     FACT_Number,
+    FACT_Variable,
     FACT_ArithExpr,
   } kind;
 
   union {
     intmax_t v_number;
+    ASTBuffer *v_variable;
     ASTArithExpr *v_arithexpr;
   };
 
   ASTFactor *next;
+  ASTFactor *tail;
 };
 
 struct ASTArithExpr {
@@ -275,84 +311,60 @@ struct ASTArithExpr {
   ASTFactor *right;
 };
 
+void *ast_arena_alloc(size_t size);
+void ast_arena_reset(void);
+void reset_current_buffers(void);
 ASTBuffer *new_ast_buffer(uint8_t *buffer, size_t length);
 ASTBuffer *new_ast_buffer_blank(void);
+ASTBuffer *ast_buffer_intern(const uint8_t *buffer, size_t length);
+bool ast_buffer_equals(ASTBuffer *buffer, const uint8_t *string, size_t length);
 bool ast_buffer_compare_string(ASTBuffer *buffer, const uint8_t *against);
 bool ast_buffer_compare_buffer(ASTBuffer *buffer, ASTBuffer *against);
+void ast_buffer_reserve(ASTBuffer *buffer, size_t extra);
 void ast_buffer_append_char(ASTBuffer *buffer, uint8_t ch);
 void ast_buffer_append_string(ASTBuffer *buffer, uint8_t *string, size_t length);
-void delete_ast_buffer(ASTBuffer *buffer);
 ASTParam *new_ast_param(enum ParamKind kind, void *hook);
 void ast_param_append(ASTParam *head, ASTParam *new_param);
-void delete_ast_param(ASTParam *param);
 ASTWordExpn *new_ast_wordexpn(enum WordExpnKind kind, void *hook);
 void ast_wordexpn_append(ASTWordExpn *head, ASTWordExpn *new_wordexpn);
-void delete_ast_wordexpn(ASTWordExpn *wordexpn);
-void delete_ast_wordexpn_chain(ASTWordExpn *head);
 ASTParamExpn *new_ast_paramexpn(ASTParam *param, ASTBuffer *punct,
                                 ASTWord *word);
-void delete_ast_paramexpn(ASTParamExpn *paramexpn);
 ASTBuffer *ast_digit_to_buffer(long digit);
 void ast_buffer_append(ASTBuffer *buffer, ASTBuffer *new_buffer);
-void delete_ast_buffer_chain(ASTBuffer *head);
 ASTSimpleCommand *new_ast_simple_command(ASTBuffer *prefix, ASTWord *argv0);
 void ast_simple_command_append(ASTSimpleCommand *head,
                                ASTSimpleCommand *new_command);
-void delete_ast_simple_command(ASTSimpleCommand *simplecmd);
-void delete_ast_simple_command_chain(ASTSimpleCommand *head);
 ASTRedir *new_ast_redir(enum RedirKind kind, ASTBuffer *subj);
-void delete_ast_redir(ASTRedir *redir);
 ASTWord *new_ast_word(enum WordKind kind, void *new_word);
+ASTAssign *new_ast_assign(ASTBuffer *name, ASTWord *value);
 void ast_word_append(ASTWord *word, ASTWord *new_word);
-void delete_ast_word(ASTWord *word);
-void delete_ast_word_chain(ASTWord *head);
 ASTPipeline *new_ast_pipeline(ASTSimpleCommand *head);
 void ast_pipeline_append(ASTPipeline *head, ASTPipeline *new_pipeline);
-void delete_ast_pipeline_chain(ASTPipeline *head);
-void delete_ast_pipeline(ASTPipeline *pipeline);
-ASTList *new_ast_list(ASTCompound *head);
+ASTList *new_ast_list(ASTPipeline *head);
 void ast_list_append(ASTList *head, ASTList *new_list);
-void delete_ast_list(ASTList *list);
-void delete_ast_list_chain(ASTList *head);
 ASTCompound *new_ast_compound(enum CompoundKind kind, void *hook);
 void ast_compound_append(ASTCompound *head, ASTCompound *new_compound);
-void delete_ast_compound(ASTCompound *compound);
-void delete_ast_compound_chain(ASTCompound *head);
 ASTWhileLoop *new_ast_whileloop(ASTCompoundList *cond, ASTCompoundList *body);
 ASTUntilLoop *new_ast_untilloop(ASTCompoundList *cond, ASTCompoundList *body);
 ASTForLoop *new_ast_forloop(ASTBuffer *buffer, ASTBuffer *iter,
                             ASTCompoundList *body);
-ASTCaseCond *new_ast_casecond(ASTBuffer *discrim);
+ASTCaseCond *new_ast_casecond(ASTWord *discrim);
 ASTIfCond *new_ast_ifcond(void);
-void delete_ast_whileloop(ASTWhileLoop *whileloop);
-void delete_ast_untilloop(ASTUntilLoop *untilloop);
-void delete_ast_forloop(ASTForLoop *forloop);
-void delete_ast_casecond(ASTCaseCond *casecond);
-void delete_ast_ifcond(ASTIfCond *ifcond);
 void ast_casecond_pair_append(ASTCaseCond *casecond, ASTPattern *clause,
                               ASTCompoundList *body);
 void ast_ifcond_pair_append(ASTIfCond *ifcond, ASTCompoundList *cond,
                             ASTCompoundList *body);
-ASTPattern *new_ast_pattern(enum PatternKind kind, ASTBracket *bracket);
+ASTPattern *new_ast_pattern(enum PatternKind kind, void *hook);
 void ast_pattern_append(ASTPattern *head, ASTPattern *new_pattern);
-void delete_ast_pattern(ASTPattern *pattern);
-void delete_ast_pattern_chain(ASTPattern *head);
+void ast_pattern_alternate(ASTPattern *head, ASTPattern *alternative);
 ASTCharRange *new_ast_charrange(char start, char end);
 void ast_charrange_append(ASTCharRange *head, ASTCharRange *new_charrange);
-void delete_ast_charrange(ASTCharRange *charrange);
-void delete_ast_charrange_chain(ASTCharRange *head);
 ASTBracket *new_ast_bracket(ASTCharRange *ranges, bool negate);
-void delete_ast_bracket(ASTBracket *bracket);
 ASTFuncDef *new_ast_funcdef(ASTBuffer *name, ASTCompound *body,
                             ASTRedir *redir);
-void delete_ast_funcdef(ASTFuncDef funcdef);
 ASTCompoundList *new_ast_compound_list(ASTList *head);
-void delete_ast_compound_list(ASTCompoundList *compoundlist);
 ASTFactor *new_ast_factor(enum FactorKind kind, void *hook);
 void ast_factor_append(ASTFactor *head, ASTFactor *new_factor);
-void delete_ast_factor(ASTFactor *factor);
-void delete_ast_factor_chain(ASTFactor *head);
 ASTArithExpr *new_ast_arithexpr(enum OperatorKind op, ASTFactor *left,
                                 ASTFactor *right);
-void delete_ast_arithexpr(ASTArithExpr *arithexpr);
 #endif
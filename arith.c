@@ -0,0 +1,312 @@
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "absyn.h"
+#include "arith.h"
+
+typedef struct ArithBuilder {
+  intmax_t *consts;
+  uint32_t nconsts;
+  uint32_t consts_capacity;
+  ArithInsn *insns;
+  uint32_t ninsns;
+  uint32_t insns_capacity;
+  char *names;
+  uint32_t nnames;
+  uint32_t names_capacity;
+  uint32_t nregs;
+} ArithBuilder;
+
+static bool fold_factor(ASTFactor *factor) {
+  if (factor->kind != FACT_ArithExpr)
+    return factor->kind == FACT_Number;
+
+  intmax_t value;
+  if (!fold_arith(factor->v_arithexpr, &value))
+    return false;
+
+  factor->kind = FACT_Number;
+  factor->v_number = value;
+  return true;
+}
+
+bool fold_arith(ASTArithExpr *expr, intmax_t *value) {
+  bool left = fold_factor(expr->left);
+  bool right = fold_factor(expr->right);
+
+  return left && right &&
+         arith_apply(expr->op, expr->left->v_number, expr->right->v_number,
+                     value);
+}
+
+static void *builder_grow(void *memory, uint32_t *capacity, uint32_t needed,
+                          size_t size) {
+  if (needed <= *capacity)
+    return memory;
+
+  uint32_t new_capacity = *capacity ? *capacity : 8;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  memory = realloc(memory, new_capacity * size);
+
+  if (memory == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  *capacity = new_capacity;
+  return memory;
+}
+
+static void emit_insn(ArithBuilder *builder, uint8_t op, uint32_t dst,
+                      uint32_t left, uint32_t right, uint32_t arg) {
+  builder->insns = builder_grow(builder->insns, &builder->insns_capacity,
+                                builder->ninsns + 1, sizeof(ArithInsn));
+  builder->insns[builder->ninsns++] = (ArithInsn){op, dst, left, right, arg};
+  if (dst + 1 > builder->nregs)
+    builder->nregs = dst + 1;
+}
+
+static uint32_t add_const(ArithBuilder *builder, intmax_t value) {
+  for (uint32_t i = 0; i < builder->nconsts; i++)
+    if (builder->consts[i] == value)
+      return i;
+
+  builder->consts = builder_grow(builder->consts, &builder->consts_capacity,
+                                 builder->nconsts + 1, sizeof(intmax_t));
+  builder->consts[builder->nconsts] = value;
+  return builder->nconsts++;
+}
+
+static uint32_t add_name(ArithBuilder *builder, ASTBuffer *name) {
+  uint32_t offset = builder->nnames;
+  builder->names = builder_grow(builder->names, &builder->names_capacity,
+                                offset + name->length + 1, 1);
+  memcpy(&builder->names[offset], name->buffer, name->length);
+  builder->names[offset + name->length] = '\0';
+  builder->nnames += name->length + 1;
+  return offset;
+}
+
+/* Registers needed to evaluate a subtree when the heavier side goes first. */
+static uint32_t factor_need(ASTFactor *factor) {
+  if (factor->kind != FACT_ArithExpr)
+    return 1;
+
+  uint32_t left = factor_need(factor->v_arithexpr->left);
+  uint32_t right = factor_need(factor->v_arithexpr->right);
+  return left == right ? left + 1 : left > right ? left : right;
+}
+
+static void compile_factor(ArithBuilder *builder, ASTFactor *factor,
+                           uint32_t dst) {
+  switch (factor->kind) {
+  case FACT_Number:
+    emit_insn(builder, ARITH_Const, dst, 0, 0,
+              add_const(builder, factor->v_number));
+    break;
+  case FACT_Variable:
+    /* Name offsets are patched to absolute ones once the layout is known. */
+    emit_insn(builder, ARITH_Load, dst, 0, 0,
+              add_name(builder, factor->v_variable));
+    break;
+  case FACT_ArithExpr: {
+    ASTArithExpr *expr = factor->v_arithexpr;
+
+    if (factor_need(expr->left) >= factor_need(expr->right)) {
+      compile_factor(builder, expr->left, dst);
+      compile_factor(builder, expr->right, dst + 1);
+      emit_insn(builder, ARITH_Add + expr->op, dst, dst, dst + 1, 0);
+    } else {
+      compile_factor(builder, expr->right, dst);
+      compile_factor(builder, expr->left, dst + 1);
+      emit_insn(builder, ARITH_Add + expr->op, dst, dst + 1, dst, 0);
+    }
+    break;
+  }
+  }
+}
+
+ArithProgram *arith_compile(ASTArithExpr *expr) {
+  ASTFactor root = {.kind = FACT_ArithExpr, .v_arithexpr = expr};
+
+  if (factor_need(&root) > ARITH_REGS_MAX)
+    return NULL;
+
+  ArithBuilder builder = {0};
+  compile_factor(&builder, &root, 0);
+
+  size_t names_offset = sizeof(ArithProgram) +
+                        builder.nconsts * sizeof(intmax_t) +
+                        builder.ninsns * sizeof(ArithInsn);
+  size_t size = names_offset + builder.nnames;
+  ArithProgram *program = malloc(size);
+
+  if (program == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t i = 0; i < builder.ninsns; i++)
+    if (builder.insns[i].op == ARITH_Load)
+      builder.insns[i].arg += names_offset;
+
+  program->size = size;
+  program->nconsts = builder.nconsts;
+  program->ninsns = builder.ninsns;
+  program->nregs = builder.nregs;
+  if (builder.nconsts)
+    memcpy((intmax_t *)arith_consts(program), builder.consts,
+           builder.nconsts * sizeof(intmax_t));
+  memcpy((ArithInsn *)arith_insns(program), builder.insns,
+         builder.ninsns * sizeof(ArithInsn));
+  if (builder.nnames)
+    memcpy((char *)program + names_offset, builder.names, builder.nnames);
+
+  free(builder.consts);
+  free(builder.insns);
+  free(builder.names);
+  return program;
+}
+
+static bool parse_operand(const char *name, const char *text,
+                          intmax_t *value) {
+  if (text == NULL) {
+    *value = 0;
+    return true;
+  }
+
+  const char *p = text;
+  while (isspace((unsigned char)*p))
+    p++;
+
+  if (*p == '\0') {
+    *value = 0;
+    return true;
+  }
+
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+')
+    p++;
+
+  /* Plain decimal is what counters hold; take it without strtoimax. */
+  uintmax_t magnitude = 0;
+  const char *digits = p;
+  while (*p >= '0' && *p <= '9' && p - digits < 18)
+    magnitude = magnitude * 10 + (*p++ - '0');
+
+  if (p != digits && (*p == '\0' || isspace((unsigned char)*p)) &&
+      !(*digits == '0' && p - digits > 1)) {
+    while (isspace((unsigned char)*p))
+      p++;
+    if (*p == '\0') {
+      *value = negative ? (intmax_t)(0 - magnitude) : (intmax_t)magnitude;
+      return true;
+    }
+  }
+
+  char *end;
+  errno = 0;
+  *value = strtoimax(text, &end, 0);
+  while (isspace((unsigned char)*end))
+    end++;
+
+  if (errno || end == text || *end != '\0') {
+    fprintf(stderr, "squash: %s: %s: invalid arithmetic operand\n", name,
+            text);
+    return false;
+  }
+  return true;
+}
+
+bool arith_eval(const ArithProgram *program, ArithLookup lookup,
+                intmax_t *result) {
+  intmax_t regs[ARITH_REGS_MAX];
+  const intmax_t *consts = arith_consts(program);
+  const ArithInsn *insn = arith_insns(program);
+  const ArithInsn *end = insn + program->ninsns;
+
+  for (; insn < end; insn++) {
+    switch (insn->op) {
+    case ARITH_Const:
+      regs[insn->dst] = consts[insn->arg];
+      break;
+    case ARITH_Load: {
+      const char *name = arith_name(program, insn->arg);
+      if (!parse_operand(name, lookup(name), &regs[insn->dst]))
+        return false;
+      break;
+    }
+    default:
+      if (!arith_apply(insn->op - ARITH_Add, regs[insn->left],
+                       regs[insn->right], &regs[insn->dst])) {
+        fprintf(stderr, "squash: division by 0\n");
+        return false;
+      }
+      break;
+    }
+  }
+
+  *result = regs[0];
+  return true;
+}
+
+bool arith_verify(const ArithProgram *program, size_t available) {
+  if (available < sizeof(ArithProgram) || program->size > available ||
+      program->size < sizeof(ArithProgram) || program->ninsns == 0 ||
+      program->nregs == 0 || program->nregs > ARITH_REGS_MAX ||
+      program->nconsts > (program->size - sizeof(ArithProgram)) /
+                             sizeof(intmax_t) ||
+      program->ninsns > (program->size - sizeof(ArithProgram) -
+                         program->nconsts * sizeof(intmax_t)) /
+                            sizeof(ArithInsn))
+    return false;
+
+  const ArithInsn *insns = arith_insns(program);
+  size_t names_offset = (const char *)(insns + program->ninsns) -
+                        (const char *)program;
+  const char *base = (const char *)program;
+
+  if (names_offset < program->size && base[program->size - 1] != '\0')
+    return false;
+
+  /* Every register must be written before it is read, so evaluation never
+   * touches an uninitialised slot. */
+  uint64_t written = 0;
+
+  for (uint32_t i = 0; i < program->ninsns; i++) {
+    const ArithInsn *insn = &insns[i];
+
+    if (insn->op >= ARITH_Count || insn->dst >= program->nregs)
+      return false;
+
+    switch (insn->op) {
+    case ARITH_Const:
+      if (insn->arg >= program->nconsts)
+        return false;
+      break;
+    case ARITH_Load:
+      if (insn->arg < names_offset || insn->arg >= program->size)
+        return false;
+      break;
+    default:
+      if (insn->left >= program->nregs || insn->right >= program->nregs ||
+          !(written & (1ull << insn->left)) ||
+          !(written & (1ull << insn->right)))
+        return false;
+      break;
+    }
+
+    written |= 1ull << insn->dst;
+  }
+
+  return written & 1;
+}
@@ -0,0 +1,98 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absyn.h"
+
+#define ARITH_REGS_MAX 32
+#define ARITH_ALIGN _Alignof(intmax_t)
+
+enum ArithOp {
+  ARITH_Const,
+  ARITH_Load,
+  ARITH_Add,
+  ARITH_Sub,
+  ARITH_Mul,
+  ARITH_Div,
+  ARITH_Mod,
+  ARITH_Shr,
+  ARITH_Shl,
+  ARITH_Count,
+};
+
+typedef struct ArithInsn {
+  uint8_t op;
+  uint8_t dst;
+  uint8_t left;
+  uint8_t right;
+  uint32_t arg;
+} ArithInsn;
+
+typedef struct ArithProgram {
+  uint32_t size;
+  uint32_t nconsts;
+  uint32_t ninsns;
+  uint32_t nregs;
+} ArithProgram;
+
+typedef const char *(*ArithLookup)(const char *name);
+
+static inline const intmax_t *arith_consts(const ArithProgram *program) {
+  return (const intmax_t *)(program + 1);
+}
+
+static inline const ArithInsn *arith_insns(const ArithProgram *program) {
+  return (const ArithInsn *)(arith_consts(program) + program->nconsts);
+}
+
+static inline const char *arith_name(const ArithProgram *program,
+                                     uint32_t offset) {
+  return (const char *)program + offset;
+}
+
+/* Wraps on overflow like two's complement hardware; fails only on a zero
+ * divisor so callers can leave that to run time. */
+static inline bool arith_apply(enum OperatorKind op, intmax_t left,
+                               intmax_t right, intmax_t *result) {
+  uintmax_t a = left, b = right;
+
+  switch (op) {
+  case OP_Add:
+    *result = (intmax_t)(a + b);
+    return true;
+  case OP_Sub:
+    *result = (intmax_t)(a - b);
+    return true;
+  case OP_Mul:
+    *result = (intmax_t)(a * b);
+    return true;
+  case OP_Div:
+    if (right == 0)
+      return false;
+    *result = right == -1 ? (intmax_t)(0 - a) : left / right;
+    return true;
+  case OP_Mod:
+    if (right == 0)
+      return false;
+    *result = right == -1 ? 0 : left % right;
+    return true;
+  case OP_Shr:
+    *result = left >> (b & 63);
+    return true;
+  case OP_Shl:
+    *result = (intmax_t)(a << (b & 63));
+    return true;
+  }
+  return false;
+}
+
+bool fold_arith(ASTArithExpr *expr, intmax_t *value);
+ArithProgram *arith_compile(ASTArithExpr *expr);
+bool arith_eval(const ArithProgram *program, ArithLookup lookup,
+                intmax_t *result);
+bool arith_verify(const ArithProgram *program, size_t available);
+
+#endif
@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "memory.h"
+
+#define OPS 1000000
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_heap_size(size_t live) {
+  gc_init();
+
+  void **keep = malloc(live * sizeof(void *));
+  for (size_t i = 0; i < live; i++)
+    keep[i] = gc_incref(gc_alloc(24));
+
+  double start = now();
+  for (size_t i = 0; i < OPS; i++) {
+    void *mem = gc_alloc(24);
+    gc_incref(mem);
+    gc_decref(keep[i % live]);
+    gc_incref(keep[i % live]);
+    mem = gc_realloc(mem, 48);
+    gc_free(mem);
+  }
+  double elapsed = now() - start;
+
+  printf("%10zu live objects: %12.0f allocs/s\n", live, OPS / elapsed);
+
+  for (size_t i = 0; i < live; i++)
+    gc_free(keep[i]);
+  free(keep);
+  gc_shutdown();
+}
+
+int main(void) {
+  size_t sizes[] = {1000, 10000, 100000, 1000000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    bench_heap_size(sizes[i]);
+  return 0;
+}
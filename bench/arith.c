@@ -0,0 +1,77 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "absyn.h"
+#include "arith.h"
+
+#define OPS 10000000
+
+static char counter[32] = "0";
+
+/* The scanner is not linked into the benchmark. */
+void reset_current_buffers(void) {}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *lookup(const char *name) {
+  return name[0] == 'i' ? counter : "7";
+}
+
+static ASTFactor *number(intmax_t value) {
+  return new_ast_factor(FACT_Number, &value);
+}
+
+static ASTFactor *variable(const char *name) {
+  return new_ast_factor(FACT_Variable,
+                        new_ast_buffer((uint8_t *)name, strlen(name)));
+}
+
+static ASTFactor *binary(enum OperatorKind op, ASTFactor *left,
+                         ASTFactor *right) {
+  return new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(op, left, right));
+}
+
+static void bench_expression(const char *label, ASTFactor *factor) {
+  ArithProgram *program = arith_compile(factor->v_arithexpr);
+  intmax_t value = 0;
+
+  strcpy(counter, "0");
+  double start = now();
+  for (size_t i = 0; i < OPS; i++) {
+    if (!arith_eval(program, lookup, &value))
+      exit(EXIT_FAILURE);
+    /* Store the result back as i=$((...)) would. */
+    snprintf(counter, sizeof(counter), "%jd", value);
+  }
+  double elapsed = now() - start;
+
+  printf("%-28s %3u insns %12.0f evals/s  (result %jd)\n", label,
+         program->ninsns, OPS / elapsed, value);
+  free(program);
+}
+
+int main(void) {
+  bench_expression("i + 1", binary(OP_Add, variable("i"), number(1)));
+  bench_expression(
+      "(i * 3 + j) % (4096 - 1)",
+      binary(OP_Mod,
+             binary(OP_Add, binary(OP_Mul, variable("i"), number(3)),
+                    variable("j")),
+             binary(OP_Sub, number(4096), number(1))));
+  bench_expression(
+      "((i << 2) - (j >> 1)) / 3",
+      binary(OP_Div,
+             binary(OP_Sub, binary(OP_Shl, variable("i"), number(2)),
+                    binary(OP_Shr, variable("j"), number(1))),
+             number(3)));
+  ast_arena_reset();
+  return 0;
+}
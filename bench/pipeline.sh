@@ -0,0 +1,32 @@
+#!/bin/sh
+# Measures pipeline throughput through squash.
+# Usage: bench/pipeline.sh [megabytes] [stages] [pipesize]
+# e.g.   bench/pipeline.sh 4096 4 1M
+
+megabytes=${1:-4096}
+stages=${2:-4}
+pipesize=${3:-}
+squash=${SQUASH:-./squash}
+
+pipeline="head -c $((megabytes * 1048576)) /dev/zero"
+i=0
+while [ "$i" -lt "$stages" ]; do
+  pipeline="$pipeline | cat"
+  i=$((i + 1))
+done
+pipeline="$pipeline | wc -c"
+
+setup=
+if [ -n "$pipesize" ]; then
+  setup="set -o pipesize=$pipesize"
+fi
+
+start=$(date +%s.%N)
+printf '%s\n%s\n' "$setup" "$pipeline" | "$squash" >/dev/null 2>&1
+end=$(date +%s.%N)
+
+awk -v mb="$megabytes" -v n="$stages" -v p="${pipesize:-default}" \
+    -v s="$start" -v e="$end" 'BEGIN {
+  printf "%d MB through %d stages (pipesize %s) in %.3f s: %.1f MB/s\n",
+         mb, n, p, e - s, mb / (e - s)
+}'
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Compares cold (parse and compile) and warm (cached image) script startup.
+# Usage: bench/script.sh [lines] [runs]
+# e.g.   bench/script.sh 5000 50
+
+lines=${1:-5000}
+runs=${2:-50}
+squash=${SQUASH:-./squash}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+script="$work/script.sh"
+i=0
+while [ "$i" -lt "$lines" ]; do
+  echo ": line $i \$HOME ~ && true || false" >>"$script"
+  i=$((i + 1))
+done
+
+run() {
+  start=$(date +%s.%N)
+  i=0
+  while [ "$i" -lt "$runs" ]; do
+    if [ "$1" = cold ]; then
+      rm -rf "$work/cache"
+    fi
+    XDG_CACHE_HOME="$work/cache" "$squash" "$script" >/dev/null 2>&1
+    i=$((i + 1))
+  done
+  end=$(date +%s.%N)
+
+  awk -v mode="$1" -v n="$runs" -v l="$lines" -v s="$start" -v e="$end" 'BEGIN {
+    printf "%-4s %d lines x %d runs: %.3f ms per run\n",
+           mode, l, n, (e - s) * 1000 / n
+  }'
+}
+
+run cold
+XDG_CACHE_HOME="$work/cache" "$squash" "$script" >/dev/null 2>&1
+run warm
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Measures how many `true` commands per second squash can launch.
+# Usage: bench/spawn.sh [count]
+
+count=${1:-2000}
+squash=${SQUASH:-./squash}
+
+start=$(date +%s.%N)
+yes true | head -n "$count" | "$squash" >/dev/null 2>&1
+end=$(date +%s.%N)
+
+awk -v n="$count" -v s="$start" -v e="$end" 'BEGIN {
+  printf "%d commands in %.3f s: %.0f commands/s\n", n, e - s, n / (e - s)
+}'
@@ -0,0 +1,507 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "builtin.h"
+#include "cmdhash.h"
+#include "common.h"
+#include "job.h"
+#include "memory.h"
+#include "vars.h"
+
+extern bool do_exit;
+extern int exit_status;
+
+static const Builtin builtins[] = {
+    {":", builtin_true},
+    {"[", builtin_test},
+    {"bg", builtin_bg},
+    {"cd", builtin_cd},
+    {"echo", builtin_echo},
+    {"exit", builtin_exit},
+    {"export", builtin_export},
+    {"false", builtin_false},
+    {"fg", builtin_fg},
+    {"gcstat", builtin_gcstat},
+    {"hash", builtin_hash},
+    {"printf", builtin_printf},
+    {"set", builtin_set},
+    {"test", builtin_test},
+    {"true", builtin_true},
+    {"unset", builtin_unset},
+};
+
+static int compare_builtin(const void *key, const void *entry) {
+  return strcmp(key, ((const Builtin *)entry)->name);
+}
+
+BuiltinFn find_builtin(const char *name) {
+  const Builtin *builtin =
+      bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]),
+              sizeof(builtins[0]), compare_builtin);
+  return builtin ? builtin->fn : NULL;
+}
+
+int builtin_gcstat(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+
+  GCStats stats;
+  gc_get_stats(&stats);
+
+  printf("minor collections: %zu\n", stats.minor_collections);
+  printf("major collections: %zu\n", stats.major_collections);
+  printf("bytes freed:       %zu\n", stats.bytes_freed);
+  printf("live objects:      %zu\n", stats.live_objects);
+  printf("live bytes:        %zu\n", stats.live_bytes);
+  printf("pauses:            %zu\n", stats.pauses);
+  printf("max pause:         %lu us\n", (unsigned long)stats.max_pause_us);
+  printf("avg pause:         %lu us\n",
+         stats.pauses ? (unsigned long)(stats.total_pause_us / stats.pauses)
+                      : 0UL);
+  return 0;
+}
+
+int builtin_hash(int argc, char **argv) {
+  int status = 0;
+
+  if (argc == 1) {
+    cmdhash_print();
+    return 0;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r")) {
+      cmdhash_flush();
+    } else if (cmdhash_lookup(argv[i]) == NULL) {
+      fprintf(stderr, "hash: %s: not found\n", argv[i]);
+      status = 1;
+    }
+  }
+
+  return status;
+}
+
+int builtin_true(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  return 0;
+}
+
+int builtin_false(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  return 1;
+}
+
+int builtin_cd(int argc, char **argv) {
+  const char *dir = argc > 1 ? argv[1] : vars_get("HOME");
+  char cwd[4096];
+
+  if (dir != NULL && !strcmp(dir, "-")) {
+    dir = vars_get("OLDPWD");
+    if (dir)
+      printf("%s\n", dir);
+  }
+
+  if (dir == NULL) {
+    fprintf(stderr, "cd: no directory\n");
+    return 1;
+  }
+
+  if (getcwd(cwd, sizeof(cwd)) == NULL)
+    cwd[0] = '\0';
+
+  if (chdir(dir) == -1) {
+    perror("cd");
+    return 1;
+  }
+
+  vars_set("OLDPWD", cwd, strlen(cwd));
+  if (getcwd(cwd, sizeof(cwd)) != NULL)
+    vars_set("PWD", cwd, strlen(cwd));
+  return 0;
+}
+
+int builtin_echo(int argc, char **argv) {
+  bool newline = true;
+  int i = 1;
+
+  if (i < argc && !strcmp(argv[i], "-n")) {
+    newline = false;
+    i++;
+  }
+
+  for (; i < argc; i++) {
+    fputs(argv[i], stdout);
+    if (i + 1 < argc)
+      putchar(' ');
+  }
+
+  if (newline)
+    putchar('\n');
+  return 0;
+}
+
+static const char *print_escape(const char *format) {
+  switch (*format) {
+  case 'n':
+    putchar('\n');
+    break;
+  case 't':
+    putchar('\t');
+    break;
+  case 'r':
+    putchar('\r');
+    break;
+  case 'a':
+    putchar('\a');
+    break;
+  case '\\':
+    putchar('\\');
+    break;
+  case '\0':
+    putchar('\\');
+    return format;
+  default:
+    putchar('\\');
+    putchar(*format);
+    break;
+  }
+  return format + 1;
+}
+
+int builtin_printf(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "printf: usage: printf format [arguments]\n");
+    return 1;
+  }
+
+  const char *format = argv[1];
+  int arg = 2;
+
+  do {
+    const char *cursor = format;
+    bool consumed = false;
+
+    while (*cursor) {
+      if (*cursor == '\\') {
+        cursor = print_escape(cursor + 1);
+        continue;
+      }
+
+      if (*cursor != '%') {
+        putchar(*cursor++);
+        continue;
+      }
+
+      char spec[32];
+      char full[40];
+      size_t length = 0;
+      spec[length++] = *cursor++;
+      while (*cursor && strchr("-+ #0123456789.", *cursor) &&
+             length < sizeof(spec) - 1)
+        spec[length++] = *cursor++;
+      spec[length] = '\0';
+
+      const char *value = arg < argc ? argv[arg] : NULL;
+      char conv = *cursor ? *cursor++ : '\0';
+
+      switch (conv) {
+      case '%':
+        putchar('%');
+        continue;
+      case 's':
+        snprintf(full, sizeof(full), "%ss", spec);
+        printf(full, value ? value : "");
+        break;
+      case 'c':
+        if (value && *value)
+          putchar(*value);
+        break;
+      case 'd':
+      case 'i':
+        snprintf(full, sizeof(full), "%sjd", spec);
+        printf(full, value ? strtoimax(value, NULL, 0) : (intmax_t)0);
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'o':
+        snprintf(full, sizeof(full), "%sj%c", spec, conv);
+        printf(full, value ? strtoumax(value, NULL, 0) : (uintmax_t)0);
+        break;
+      default:
+        fprintf(stderr, "printf: %c: invalid conversion\n", conv);
+        return 1;
+      }
+
+      consumed = true;
+      if (arg < argc)
+        arg++;
+    }
+
+    if (!consumed)
+      break;
+  } while (arg < argc);
+
+  return 0;
+}
+
+static bool test_unary(const char *op, const char *operand) {
+  struct stat st;
+
+  switch (op[1]) {
+  case 'n':
+    return *operand != '\0';
+  case 'z':
+    return *operand == '\0';
+  case 'e':
+    return stat(operand, &st) == 0;
+  case 'f':
+    return stat(operand, &st) == 0 && S_ISREG(st.st_mode);
+  case 'd':
+    return stat(operand, &st) == 0 && S_ISDIR(st.st_mode);
+  case 's':
+    return stat(operand, &st) == 0 && st.st_size > 0;
+  case 'L':
+  case 'h':
+    return lstat(operand, &st) == 0 && S_ISLNK(st.st_mode);
+  case 'r':
+    return access(operand, R_OK) == 0;
+  case 'w':
+    return access(operand, W_OK) == 0;
+  case 'x':
+    return access(operand, X_OK) == 0;
+  }
+
+  return false;
+}
+
+static int test_binary(const char *left, const char *op, const char *right) {
+  if (!strcmp(op, "="))
+    return !strcmp(left, right);
+  if (!strcmp(op, "!="))
+    return strcmp(left, right) != 0;
+
+  intmax_t a = strtoimax(left, NULL, 10);
+  intmax_t b = strtoimax(right, NULL, 10);
+
+  if (!strcmp(op, "-eq"))
+    return a == b;
+  if (!strcmp(op, "-ne"))
+    return a != b;
+  if (!strcmp(op, "-lt"))
+    return a < b;
+  if (!strcmp(op, "-le"))
+    return a <= b;
+  if (!strcmp(op, "-gt"))
+    return a > b;
+  if (!strcmp(op, "-ge"))
+    return a >= b;
+  return -1;
+}
+
+int builtin_test(int argc, char **argv) {
+  bool negate = false;
+  int first = 1;
+
+  if (!strcmp(argv[0], "[")) {
+    if (strcmp(argv[argc - 1], "]")) {
+      fprintf(stderr, "[: missing ]\n");
+      return 2;
+    }
+    argc--;
+  }
+
+  if (first < argc && !strcmp(argv[first], "!") && argc - first > 1) {
+    negate = true;
+    first++;
+  }
+
+  int result;
+  switch (argc - first) {
+  case 0:
+    result = false;
+    break;
+  case 1:
+    result = argv[first][0] != '\0';
+    break;
+  case 2:
+    if (argv[first][0] != '-' || strlen(argv[first]) != 2) {
+      fprintf(stderr, "%s: %s: unary operator expected\n", argv[0],
+              argv[first]);
+      return 2;
+    }
+    result = test_unary(argv[first], argv[first + 1]);
+    break;
+  case 3:
+    result = test_binary(argv[first], argv[first + 1], argv[first + 2]);
+    if (result == -1) {
+      fprintf(stderr, "%s: %s: binary operator expected\n", argv[0],
+              argv[first + 1]);
+      return 2;
+    }
+    break;
+  default:
+    fprintf(stderr, "%s: too many arguments\n", argv[0]);
+    return 2;
+  }
+
+  return (result != negate) ? 0 : 1;
+}
+
+int builtin_exit(int argc, char **argv) {
+  exit_status = argc > 1 ? atoi(argv[1]) & 0xff : 0;
+  do_exit = true;
+  return exit_status;
+}
+
+static int parse_job_id(int argc, char **argv) {
+  if (argc < 2) {
+    Job *job = find_current_job();
+    return job ? job->job_id : -1;
+  }
+
+  const char *spec = argv[1];
+  if (*spec == '%')
+    spec++;
+  return atoi(spec);
+}
+
+int builtin_fg(int argc, char **argv) {
+  int status = execute_fg(parse_job_id(argc, argv));
+  if (status == -1) {
+    fprintf(stderr, "fg: no such job\n");
+    return 1;
+  }
+  return status;
+}
+
+int builtin_bg(int argc, char **argv) {
+  if (execute_bg(parse_job_id(argc, argv)) == -1) {
+    fprintf(stderr, "bg: no such job\n");
+    return 1;
+  }
+  return 0;
+}
+
+static void print_options(void) {
+  printf("pipefail\t%s\n", shell_options.pipefail ? "on" : "off");
+  if (shell_options.pipesize > 0)
+    printf("pipesize\t%d\n", shell_options.pipesize);
+  else
+    printf("pipesize\tdefault\n");
+}
+
+static long pipe_max_size(void) {
+  FILE *file = fopen("/proc/sys/fs/pipe-max-size", "r");
+  long size = -1;
+
+  if (file == NULL)
+    return -1;
+  if (fscanf(file, "%ld", &size) != 1)
+    size = -1;
+  fclose(file);
+  return size;
+}
+
+static int parse_size(const char *text) {
+  char *end;
+  long size = strtol(text, &end, 10);
+
+  if (end == text || size < 0)
+    return -1;
+
+  switch (*end) {
+  case 'k':
+  case 'K':
+    size *= 1024;
+    end++;
+    break;
+  case 'm':
+  case 'M':
+    size *= 1024 * 1024;
+    end++;
+    break;
+  }
+
+  if (*end != '\0' || size > INT32_MAX)
+    return -1;
+  return size;
+}
+
+int builtin_set(int argc, char **argv) {
+  if (argc == 1) {
+    print_options();
+    return 0;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    bool enable = argv[i][0] == '-';
+
+    if (strcmp(argv[i], "-o") && strcmp(argv[i], "+o")) {
+      fprintf(stderr, "set: %s: invalid option\n", argv[i]);
+      return 2;
+    }
+
+    if (++i == argc) {
+      print_options();
+      return 0;
+    }
+
+    if (!strcmp(argv[i], "pipefail")) {
+      shell_options.pipefail = enable;
+    } else if (!strncmp(argv[i], "pipesize", 8) &&
+               (argv[i][8] == '\0' || argv[i][8] == '=')) {
+      int size = enable && argv[i][8] == '=' ? parse_size(&argv[i][9]) : 0;
+      if (size == -1) {
+        fprintf(stderr, "set: %s: invalid pipe size\n", &argv[i][9]);
+        return 2;
+      }
+      /* Only privileged processes may go above the system-wide cap. */
+      long max = pipe_max_size();
+      if (size > 0 && max > 0 && size > max && geteuid() != 0) {
+        fprintf(stderr, "set: %s: pipe size exceeds pipe-max-size (%ld)\n",
+                &argv[i][9], max);
+        return 2;
+      }
+      shell_options.pipesize = size;
+    } else {
+      fprintf(stderr, "set: %s: invalid option name\n", argv[i]);
+      return 2;
+    }
+  }
+
+  return 0;
+}
+
+int builtin_export(int argc, char **argv) {
+  if (argc == 1) {
+    vars_print(true);
+    return 0;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    char *equals = strchr(argv[i], '=');
+    if (equals) {
+      *equals = '\0';
+      vars_set(argv[i], equals + 1, strlen(equals + 1));
+    }
+    vars_export(argv[i]);
+  }
+
+  return 0;
+}
+
+int builtin_unset(int argc, char **argv) {
+  for (int i = 1; i < argc; i++)
+    vars_unset(argv[i]);
+  return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+typedef int (*BuiltinFn)(int argc, char **argv);
+
+typedef struct Builtin {
+  const char *name;
+  BuiltinFn fn;
+} Builtin;
+
+int builtin_true(int argc, char **argv);
+int builtin_false(int argc, char **argv);
+int builtin_cd(int argc, char **argv);
+int builtin_echo(int argc, char **argv);
+int builtin_printf(int argc, char **argv);
+int builtin_test(int argc, char **argv);
+int builtin_exit(int argc, char **argv);
+int builtin_fg(int argc, char **argv);
+int builtin_bg(int argc, char **argv);
+int builtin_set(int argc, char **argv);
+int builtin_gcstat(int argc, char **argv);
+int builtin_hash(int argc, char **argv);
+int builtin_export(int argc, char **argv);
+int builtin_unset(int argc, char **argv);
+BuiltinFn find_builtin(const char *name);
+
+#endif
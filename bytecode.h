@@ -0,0 +1,121 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absyn.h"
+
+#define BYTECODE_VERSION 8
+
+#define SPAWN_Background 0x01
+
+#define ASSIGN_Local 0x01
+
+#define END_Glob 0x01
+
+#define JUMP_IfFailure 0
+#define JUMP_IfSuccess 1
+
+#define CASE_EMPTY UINT32_MAX
+#define CASE_FNV_OFFSET_BASIS 2166136261u
+#define CASE_FNV_PRIME 16777619u
+
+enum Opcode {
+  INSN_Halt,
+  INSN_Load,
+  INSN_Begin,
+  INSN_AppendText,
+  INSN_AppendParam,
+  INSN_AppendTilde,
+  INSN_AppendArith,
+  INSN_End,
+  INSN_Arg,
+  INSN_Assign,
+  INSN_Redirect,
+  INSN_Pipe,
+  INSN_Spawn,
+  INSN_Jump,
+  INSN_JumpIf,
+  INSN_ForInit,
+  INSN_ForItem,
+  INSN_ForNext,
+  INSN_CaseSubject,
+  INSN_CaseMatch,
+  INSN_CaseDispatch,
+  INSN_CaseEnd,
+  INSN_Subshell,
+  INSN_Exit,
+  INSN_Count,
+};
+
+typedef struct Instr {
+  uint8_t op;
+  uint8_t flags;
+  int16_t fno;
+  uint32_t arg;
+} Instr;
+
+typedef struct Program {
+  size_t size;
+  uint32_t ncode;
+  uint32_t nbytes;
+  uint32_t code_offset;
+  uint32_t bytes_offset;
+} Program;
+
+typedef struct CaseTable {
+  uint32_t nslots;
+  uint32_t nglobs;
+  uint32_t default_target;
+} CaseTable;
+
+typedef struct CaseSlot {
+  uint32_t hash;
+  uint32_t key;
+  uint32_t length;
+  uint32_t arm;
+  uint32_t target;
+} CaseSlot;
+
+typedef struct CaseGlob {
+  uint32_t arm;
+  uint32_t glob;
+  uint32_t target;
+} CaseGlob;
+
+static inline Instr *program_code(const Program *program) {
+  return (Instr *)((uint8_t *)program + program->code_offset);
+}
+
+static inline const char *program_text(const Program *program, uint32_t offset) {
+  return (const char *)program + program->bytes_offset + offset;
+}
+
+static inline const CaseSlot *case_slots(const CaseTable *table) {
+  return (const CaseSlot *)(table + 1);
+}
+
+static inline const CaseGlob *case_globs(const CaseTable *table) {
+  return (const CaseGlob *)(case_slots(table) + table->nslots);
+}
+
+static inline uint32_t case_hash(const char *text, size_t length) {
+  uint32_t hash = CASE_FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)text[i];
+    hash *= CASE_FNV_PRIME;
+  }
+  return hash;
+}
+
+Program *compile_compound(ASTCompound *compound);
+void delete_program(Program *program);
+void dump_program(const Program *program);
+bool verify_program(const Program *program, size_t size);
+int run_program(const Program *program);
+int execute_compound(ASTCompound *compound);
+void set_positional_params(int argc, char **argv);
+
+#endif
@@ -0,0 +1,219 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmdhash.h"
+#include "vars.h"
+
+#define CMDHASH_INITIAL_SIZE 64
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static struct CommandTable {
+  CommandEntry *slots;
+  size_t capacity;
+  size_t count;
+  char *path_snapshot;
+} command_table = {NULL, 0, 0, NULL};
+
+static uint32_t hash_name(const char *name) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (; *name; name++) {
+    hash ^= (uint8_t)*name;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static char *cmdhash_strdup(const char *str) {
+  char *copy = strdup(str);
+
+  if (copy == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return copy;
+}
+
+static void command_table_grow(void) {
+  size_t capacity = command_table.capacity ? command_table.capacity * 2
+                                           : CMDHASH_INITIAL_SIZE;
+  CommandEntry *slots = calloc(capacity, sizeof(CommandEntry));
+
+  if (slots == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < command_table.capacity; i++) {
+    CommandEntry *entry = &command_table.slots[i];
+    if (entry->name == NULL)
+      continue;
+    size_t slot = entry->hash & (capacity - 1);
+    while (slots[slot].name != NULL)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = *entry;
+  }
+
+  free(command_table.slots);
+  command_table.slots = slots;
+  command_table.capacity = capacity;
+}
+
+void cmdhash_flush(void) {
+  for (size_t i = 0; i < command_table.capacity; i++) {
+    CommandEntry *entry = &command_table.slots[i];
+    if (entry->name == NULL)
+      continue;
+    free(entry->name);
+    free(entry->path);
+    entry->name = NULL;
+    entry->path = NULL;
+  }
+  command_table.count = 0;
+}
+
+static void check_path_snapshot(void) {
+  const char *path = vars_get("PATH");
+  if (path == NULL)
+    path = "";
+
+  if (command_table.path_snapshot &&
+      !strcmp(command_table.path_snapshot, path))
+    return;
+
+  cmdhash_flush();
+  free(command_table.path_snapshot);
+  command_table.path_snapshot = cmdhash_strdup(path);
+}
+
+static char *search_path(const char *name) {
+  const char *dir = command_table.path_snapshot;
+  size_t name_length = strlen(name);
+
+  for (;;) {
+    const char *end = strchr(dir, ':');
+    if (end == NULL)
+      end = dir + strlen(dir);
+    size_t dir_length = end - dir;
+    char *candidate = malloc(dir_length + name_length + 2);
+
+    if (candidate == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+
+    if (dir_length == 0) {
+      memcpy(candidate, name, name_length + 1);
+    } else {
+      memcpy(candidate, dir, dir_length);
+      candidate[dir_length] = '/';
+      memcpy(&candidate[dir_length + 1], name, name_length + 1);
+    }
+
+    struct stat st;
+    if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+        access(candidate, X_OK) == 0)
+      return candidate;
+
+    free(candidate);
+    if (*end == '\0')
+      return NULL;
+    dir = end + 1;
+  }
+}
+
+static CommandEntry *find_entry(const char *name, uint32_t hash) {
+  if (command_table.capacity == 0)
+    return NULL;
+
+  size_t slot = hash & (command_table.capacity - 1);
+  CommandEntry *entry;
+
+  while ((entry = &command_table.slots[slot])->name != NULL) {
+    if (entry->hash == hash && !strcmp(entry->name, name))
+      return entry;
+    slot = (slot + 1) & (command_table.capacity - 1);
+  }
+
+  return NULL;
+}
+
+const char *cmdhash_lookup(const char *name) {
+  if (strchr(name, '/'))
+    return name;
+
+  check_path_snapshot();
+
+  uint32_t hash = hash_name(name);
+  CommandEntry *entry = find_entry(name, hash);
+
+  if (entry) {
+    entry->hits++;
+    return entry->path;
+  }
+
+  char *path = search_path(name);
+  if (path == NULL)
+    return NULL;
+
+  if ((command_table.count + 1) * 10 > command_table.capacity * 7)
+    command_table_grow();
+
+  size_t slot = hash & (command_table.capacity - 1);
+  while (command_table.slots[slot].name != NULL)
+    slot = (slot + 1) & (command_table.capacity - 1);
+
+  entry = &command_table.slots[slot];
+  entry->name = cmdhash_strdup(name);
+  entry->path = path;
+  entry->hash = hash;
+  entry->hits = 1;
+  command_table.count++;
+  return entry->path;
+}
+
+bool cmdhash_forget(const char *name) {
+  CommandEntry *entry = find_entry(name, hash_name(name));
+  if (entry == NULL)
+    return false;
+
+  size_t mask = command_table.capacity - 1;
+  size_t hole = entry - command_table.slots;
+  free(entry->name);
+  free(entry->path);
+
+  /* Backward-shift deletion keeps probe chains intact without tombstones. */
+  for (size_t slot = (hole + 1) & mask; command_table.slots[slot].name != NULL;
+       slot = (slot + 1) & mask) {
+    size_t home = command_table.slots[slot].hash & mask;
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      command_table.slots[hole] = command_table.slots[slot];
+      hole = slot;
+    }
+  }
+
+  command_table.slots[hole].name = NULL;
+  command_table.slots[hole].path = NULL;
+  command_table.count--;
+  return true;
+}
+
+void cmdhash_print(void) {
+  if (command_table.count == 0) {
+    printf("hash: hash table empty\n");
+    return;
+  }
+
+  printf("hits\tcommand\n");
+  for (size_t i = 0; i < command_table.capacity; i++) {
+    CommandEntry *entry = &command_table.slots[i];
+    if (entry->name != NULL)
+      printf("%4u\t%s\n", entry->hits, entry->path);
+  }
+}
@@ -0,0 +1,19 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct CommandEntry {
+  char *name;
+  char *path;
+  uint32_t hash;
+  unsigned hits;
+} CommandEntry;
+
+const char *cmdhash_lookup(const char *name);
+bool cmdhash_forget(const char *name);
+void cmdhash_flush(void);
+void cmdhash_print(void);
+
+#endif
@@ -1,8 +1,15 @@
 #ifndef TYPES_H
 #define TYPES_H
 
-#define LINE_SIZE 4096
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SQUASH_VERSION "0.1.0"
+
 #define ARGV_MAX 256
+#define REDIR_MAX 16
+#define PIPELINE_MAX 64
 
 #define JSTAT_Running 1
 #define JSTAT_Stopped 2
@@ -10,18 +17,51 @@
 
 typedef struct Arena Arena;
 
+typedef struct Process {
+  pid_t pid;
+  int pidfd;
+  int status;
+  bool done;
+} Process;
+
 typedef struct Job {
   int job_id;
   pid_t pgid;
   char *command;
   int status;
-  struct Job *next;
+  int exit_code;
+  bool pending;
+  int nprocs;
+  int nalive;
+  Process procs[PIPELINE_MAX];
 } Job;
 
+typedef struct ShellOptions {
+  bool pipefail;
+  int pipesize;
+} ShellOptions;
+
+extern ShellOptions shell_options;
+
+typedef struct Redirect {
+  int kind;
+  int fno;
+  const char *target;
+  size_t length;
+} Redirect;
+
 typedef struct Command {
   int argc;
-  const char *argv[ARGV_MAX];
+  int argv_capacity;
+  const char **argv;
+  int nredirs;
+  Redirect redirs[REDIR_MAX];
+  int nassigns;
+  int assigns_capacity;
+  const char **assigns;
+  char **envp;
   struct Command *next;
+  struct Command *tail;
 } Command;
 
 
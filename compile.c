@@ -0,0 +1,894 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "absyn.h"
+#include "arith.h"
+#include "bytecode.h"
+#include "globmatch.h"
+
+#define PROGRAM_ALIGN(n)                                                       \
+  (((n) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+#define NO_PATCH UINT32_MAX
+
+typedef struct Compiler {
+  Instr *code;
+  uint32_t ncode;
+  uint32_t code_capacity;
+  char *bytes;
+  uint32_t nbytes;
+  uint32_t bytes_capacity;
+} Compiler;
+
+static void *compiler_grow(void *memory, uint32_t *capacity, uint32_t needed,
+                           size_t size) {
+  if (needed <= *capacity)
+    return memory;
+
+  uint32_t new_capacity = *capacity ? *capacity : 64;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  memory = realloc(memory, new_capacity * size);
+
+  if (memory == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  *capacity = new_capacity;
+  return memory;
+}
+
+static uint32_t emit(Compiler *compiler, uint8_t op, uint8_t flags,
+                     int16_t fno, uint32_t arg) {
+  compiler->code = compiler_grow(compiler->code, &compiler->code_capacity,
+                                 compiler->ncode + 1, sizeof(Instr));
+  compiler->code[compiler->ncode] = (Instr){op, flags, fno, arg};
+  return compiler->ncode++;
+}
+
+static uint32_t here(Compiler *compiler) { return compiler->ncode; }
+
+static void patch(Compiler *compiler, uint32_t at, uint32_t target) {
+  compiler->code[at].arg = target;
+}
+
+static void patch_chain(Compiler *compiler, uint32_t chain, uint32_t target) {
+  while (chain != NO_PATCH) {
+    uint32_t next = compiler->code[chain].arg;
+    compiler->code[chain].arg = target;
+    chain = next;
+  }
+}
+
+static void add_bytes(Compiler *compiler, const uint8_t *bytes,
+                      size_t length) {
+  compiler->bytes = compiler_grow(compiler->bytes, &compiler->bytes_capacity,
+                                  compiler->nbytes + length, 1);
+  if (length)
+    memcpy(&compiler->bytes[compiler->nbytes], bytes, length);
+  compiler->nbytes += length;
+}
+
+static uint32_t add_text(Compiler *compiler, const uint8_t *text,
+                         size_t length) {
+  uint32_t offset = compiler->nbytes;
+  add_bytes(compiler, text, length);
+  add_bytes(compiler, (const uint8_t *)"", 1);
+  return offset;
+}
+
+static uint32_t add_buffer(Compiler *compiler, ASTBuffer *buffer) {
+  if (buffer == NULL)
+    return add_text(compiler, NULL, 0);
+  return add_text(compiler, buffer->buffer, buffer->length);
+}
+
+static void add_escaped(Compiler *compiler, ASTBuffer *buffer) {
+  for (size_t i = 0; i < buffer->length; i++) {
+    uint8_t ch = buffer->buffer[i];
+    if (ch == '*' || ch == '?' || ch == '[' || ch == '\\')
+      add_bytes(compiler, (const uint8_t *)"\\", 1);
+    add_bytes(compiler, &ch, 1);
+  }
+}
+
+static uint32_t add_escaped_text(Compiler *compiler, ASTBuffer *buffer) {
+  uint32_t offset = compiler->nbytes;
+  add_escaped(compiler, buffer);
+  add_bytes(compiler, (const uint8_t *)"", 1);
+  return offset;
+}
+
+static uint32_t add_pattern(Compiler *compiler, ASTPattern *pattern) {
+  uint32_t offset = compiler->nbytes;
+
+  for (; pattern; pattern = pattern->next) {
+    switch (pattern->kind) {
+    case PATT_AnyString:
+      add_bytes(compiler, (const uint8_t *)"*", 1);
+      break;
+    case PATT_AnyChar:
+      add_bytes(compiler, (const uint8_t *)"?", 1);
+      break;
+    case PATT_Bracket:
+      add_bytes(compiler, (const uint8_t *)"[", 1);
+      if (pattern->v_bracket->negate)
+        add_bytes(compiler, (const uint8_t *)"!", 1);
+      for (ASTCharRange *range = pattern->v_bracket->ranges; range;
+           range = range->next) {
+        uint8_t text[3] = {range->start, '-', range->end};
+        add_bytes(compiler, text, range->start == range->end ? 1 : 3);
+      }
+      add_bytes(compiler, (const uint8_t *)"]", 1);
+      break;
+    case PATT_Literal:
+      add_escaped(compiler, pattern->v_literal);
+      break;
+    }
+  }
+
+  add_bytes(compiler, (const uint8_t *)"", 1);
+  return offset;
+}
+
+static uint32_t add_glob(Compiler *compiler, ASTPattern *pattern) {
+  uint32_t offset = compiler->nbytes;
+  const uint8_t *glob = glob_compile_pattern(pattern);
+  add_bytes(compiler, glob, glob_size(glob));
+  return offset;
+}
+
+static void compile_arith(Compiler *compiler, ASTArithExpr *expr) {
+  intmax_t value;
+
+  if (fold_arith(expr, &value)) {
+    char number[32];
+    int length = snprintf(number, sizeof(number), "%jd", value);
+    emit(compiler, INSN_AppendText, 0, 0,
+         add_text(compiler, (const uint8_t *)number, length));
+    return;
+  }
+
+  ArithProgram *arith = arith_compile(expr);
+
+  if (arith == NULL) {
+    fprintf(stderr, "squash: arithmetic expression too complex\n");
+    emit(compiler, INSN_AppendText, 0, 0, add_text(compiler, NULL, 0));
+    return;
+  }
+
+  while (compiler->nbytes % ARITH_ALIGN)
+    add_bytes(compiler, (const uint8_t *)"", 1);
+
+  uint32_t offset = compiler->nbytes;
+  add_bytes(compiler, (const uint8_t *)arith, arith->size);
+  add_bytes(compiler, (const uint8_t *)"", 1);
+  emit(compiler, INSN_AppendArith, 0, 0, offset);
+  free(arith);
+}
+
+static uint32_t add_assign_name(Compiler *compiler, ASTBuffer *name) {
+  uint32_t offset = compiler->nbytes;
+  add_bytes(compiler, name->buffer, name->length);
+  add_bytes(compiler, (const uint8_t *)"=", 2);
+  return offset;
+}
+
+static uint8_t word_flags(ASTWord *word) {
+  switch (word->kind) {
+  case WORD_WordExpn:
+    for (ASTWordExpn *part = word->v_wordexpn; part; part = part->next)
+      if (part->kind == WEXPN_Pattern)
+        return END_Glob;
+    return 0;
+  case WORD_Pattern:
+    return END_Glob;
+  case WORD_Assign:
+    return word->v_assign->value ? word_flags(word->v_assign->value) : 0;
+  default:
+    return 0;
+  }
+}
+
+static void append_wordexpn(Compiler *compiler, ASTWordExpn *expn,
+                            uint8_t flags) {
+  for (; expn; expn = expn->next) {
+    switch (expn->kind) {
+    case WEXPN_Text:
+      emit(compiler, INSN_AppendText, 0, 0,
+           flags & END_Glob ? add_escaped_text(compiler, expn->v_buffer)
+                            : add_buffer(compiler, expn->v_buffer));
+      break;
+    case WEXPN_TildeExpn:
+      emit(compiler, INSN_AppendTilde, 0, 0,
+           add_buffer(compiler, expn->v_buffer));
+      break;
+    case WEXPN_ParamExpn: {
+      ASTParam *param = expn->v_paramexpn->param;
+      if (param->kind == PARAM_ShellVariable)
+        emit(compiler, INSN_AppendParam, param->kind, 0,
+             add_buffer(compiler, param->v_variable));
+      else if (param->kind == PARAM_Special)
+        emit(compiler, INSN_AppendParam, param->kind, param->v_special, 0);
+      else
+        emit(compiler, INSN_AppendParam, param->kind, param->v_positional, 0);
+      break;
+    }
+    case WEXPN_Pattern:
+      emit(compiler, INSN_AppendText, 0, 0,
+           add_pattern(compiler, expn->v_pattern));
+      break;
+    case WEXPN_ArithExpr:
+      compile_arith(compiler, expn->v_arithexpr);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+static void append_word(Compiler *compiler, ASTWord *word, uint8_t flags) {
+  switch (word->kind) {
+  case WORD_WordExpn:
+  case WORD_String:
+    append_wordexpn(compiler, word->v_wordexpn, flags);
+    break;
+  case WORD_Pattern:
+    emit(compiler, INSN_AppendText, 0, 0,
+         add_pattern(compiler, word->v_pattern));
+    break;
+  case WORD_Assign:
+    emit(compiler, INSN_AppendText, 0, 0,
+         add_assign_name(compiler, word->v_assign->name));
+    if (word->v_assign->value)
+      append_word(compiler, word->v_assign->value, flags);
+    break;
+  case WORD_Redir:
+    break;
+  default:
+    emit(compiler, INSN_AppendText, 0, 0,
+         flags & END_Glob ? add_escaped_text(compiler, word->v_buffer)
+                          : add_buffer(compiler, word->v_buffer));
+    break;
+  }
+}
+
+static void compile_word(Compiler *compiler, ASTWord *word) {
+  switch (word->kind) {
+  case WORD_WordExpn:
+  case WORD_String:
+  case WORD_Pattern:
+  case WORD_Assign: {
+    uint8_t flags = word_flags(word);
+    emit(compiler, INSN_Begin, 0, 0, 0);
+    append_word(compiler, word, flags);
+    emit(compiler, INSN_End, flags, 0, 0);
+    break;
+  }
+  default:
+    emit(compiler, INSN_Load, 0, 0, add_buffer(compiler, word->v_buffer));
+    break;
+  }
+}
+
+static void compile_assign(Compiler *compiler, ASTAssign *assign,
+                           uint8_t flags) {
+  if (assign->value)
+    compile_word(compiler, assign->value);
+  else
+    emit(compiler, INSN_Load, 0, 0, add_text(compiler, NULL, 0));
+  emit(compiler, INSN_Assign, flags, 0, add_buffer(compiler, assign->name));
+}
+
+static void compile_redir(Compiler *compiler, ASTRedir *redir) {
+  emit(compiler, INSN_Load, 0, 0, add_buffer(compiler, redir->subj));
+  emit(compiler, INSN_Redirect, redir->kind, redir->fno, 0);
+}
+
+static bool has_command_word(ASTSimpleCommand *cmd) {
+  for (ASTWord *word = cmd->argv; word; word = word->next)
+    if (word->kind != WORD_Redir && word->kind != WORD_Assign)
+      return true;
+  return false;
+}
+
+static void compile_simple_command(Compiler *compiler, ASTSimpleCommand *cmd) {
+  /* Assignments ahead of a command only live in that command's environment. */
+  uint8_t assign_flags = has_command_word(cmd) ? ASSIGN_Local : 0;
+  bool prefix = true;
+
+  for (ASTWord *word = cmd->argv; word; word = word->next) {
+    if (word->kind == WORD_Redir) {
+      compile_redir(compiler, word->v_redir);
+      continue;
+    }
+    if (word->kind == WORD_Assign && prefix) {
+      compile_assign(compiler, word->v_assign, assign_flags);
+      continue;
+    }
+    prefix = false;
+    compile_word(compiler, word);
+    emit(compiler, INSN_Arg, 0, 0, 0);
+  }
+
+  if (cmd->redir)
+    compile_redir(compiler, cmd->redir);
+}
+
+static void compile_pipeline(Compiler *compiler, ASTPipeline *pipeline) {
+  for (ASTSimpleCommand *cmd = pipeline->commands; cmd; cmd = cmd->next) {
+    if (cmd != pipeline->commands)
+      emit(compiler, INSN_Pipe, 0, 0, 0);
+    compile_simple_command(compiler, cmd);
+  }
+
+  emit(compiler, INSN_Spawn,
+       pipeline->term == TERM_Amper ? SPAWN_Background : 0, 0, 0);
+}
+
+static void compile_list(Compiler *compiler, ASTList *list) {
+  for (ASTPipeline *pipeline = list->commands; pipeline;
+       pipeline = pipeline->next) {
+    uint32_t skip = NO_PATCH;
+
+    if (pipeline->sep == SEP_And)
+      skip = emit(compiler, INSN_JumpIf, JUMP_IfFailure, 0, 0);
+    else if (pipeline->sep == SEP_Or)
+      skip = emit(compiler, INSN_JumpIf, JUMP_IfSuccess, 0, 0);
+
+    compile_pipeline(compiler, pipeline);
+
+    if (skip != NO_PATCH)
+      patch(compiler, skip, here(compiler));
+  }
+}
+
+static void compile_lists(Compiler *compiler, ASTList *lists) {
+  for (ASTList *list = lists; list; list = list->next)
+    compile_list(compiler, list);
+}
+
+static void compile_compound_list(Compiler *compiler,
+                                  ASTCompoundList *compound_list) {
+  if (compound_list)
+    compile_lists(compiler, compound_list->lists);
+}
+
+static void compile_while(Compiler *compiler, ASTCompoundList *cond,
+                          ASTCompoundList *body, uint8_t exit_when) {
+  uint32_t top = here(compiler);
+  compile_compound_list(compiler, cond);
+  uint32_t exit = emit(compiler, INSN_JumpIf, exit_when, 0, 0);
+  compile_compound_list(compiler, body);
+  emit(compiler, INSN_Jump, 0, 0, top);
+  patch(compiler, exit, here(compiler));
+}
+
+static void compile_for(Compiler *compiler, ASTForLoop *forloop) {
+  emit(compiler, INSN_ForInit, 0, 0, add_buffer(compiler, forloop->name));
+
+  for (ASTBuffer *item = forloop->iter; item; item = item->next) {
+    emit(compiler, INSN_Load, 0, 0, add_buffer(compiler, item));
+    emit(compiler, INSN_ForItem, 0, 0, 0);
+  }
+
+  uint32_t top = emit(compiler, INSN_ForNext, 0, 0, 0);
+  compile_compound_list(compiler, forloop->body);
+  emit(compiler, INSN_Jump, 0, 0, top);
+  patch(compiler, top, here(compiler));
+}
+
+static void compile_if(Compiler *compiler, ASTIfCond *ifcond) {
+  uint32_t ends = NO_PATCH;
+
+  for (struct ASTIfPair *pair = ifcond->pairs; pair; pair = pair->next) {
+    compile_compound_list(compiler, pair->cond);
+    uint32_t skip = emit(compiler, INSN_JumpIf, JUMP_IfFailure, 0, 0);
+    compile_compound_list(compiler, pair->body);
+    ends = emit(compiler, INSN_Jump, 0, 0, ends);
+    patch(compiler, skip, here(compiler));
+  }
+
+  compile_compound_list(compiler, ifcond->else_body);
+  patch_chain(compiler, ends, here(compiler));
+}
+
+static bool pattern_is_literal(ASTPattern *pattern) {
+  for (; pattern; pattern = pattern->next)
+    if (pattern->kind != PATT_Literal)
+      return false;
+  return true;
+}
+
+static uint32_t add_literal_key(Compiler *compiler, ASTPattern *pattern,
+                                uint32_t *length) {
+  uint32_t offset = compiler->nbytes;
+  for (; pattern; pattern = pattern->next)
+    add_bytes(compiler, pattern->v_literal->buffer,
+              pattern->v_literal->length);
+  *length = compiler->nbytes - offset;
+  add_bytes(compiler, (const uint8_t *)"", 1);
+  return offset;
+}
+
+static uint32_t add_case_table(Compiler *compiler, ASTCaseCond *casecond,
+                               const uint32_t *targets, uint32_t nliterals,
+                               uint32_t npatterns, uint32_t default_target) {
+  uint32_t nslots = 2;
+  while (nslots < nliterals * 2)
+    nslots *= 2;
+
+  CaseSlot *slots = malloc(nslots * sizeof(CaseSlot));
+  CaseGlob *globs = malloc(npatterns * sizeof(CaseGlob));
+
+  if (slots == NULL || globs == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t i = 0; i < nslots; i++)
+    slots[i] = (CaseSlot){0, CASE_EMPTY, 0, 0, 0};
+
+  uint32_t nglobs = 0;
+  uint32_t arm = 0;
+
+  for (struct ASTCasePair *pair = casecond->pairs; pair;
+       pair = pair->next, arm++) {
+    for (ASTPattern *clause = pair->clauses; clause;
+         clause = clause->alternative) {
+      if (!pattern_is_literal(clause)) {
+        globs[nglobs++] =
+            (CaseGlob){arm, add_glob(compiler, clause), targets[arm]};
+        continue;
+      }
+
+      uint32_t length;
+      uint32_t key = add_literal_key(compiler, clause, &length);
+      const char *text = &compiler->bytes[key];
+      uint32_t hash = case_hash(text, length);
+      uint32_t slot = hash & (nslots - 1);
+
+      /* An earlier arm with the same word already wins; drop this one. */
+      while (slots[slot].key != CASE_EMPTY &&
+             !(slots[slot].hash == hash && slots[slot].length == length &&
+               !memcmp(&compiler->bytes[slots[slot].key], text, length)))
+        slot = (slot + 1) & (nslots - 1);
+
+      if (slots[slot].key == CASE_EMPTY)
+        slots[slot] = (CaseSlot){hash, key, length, arm, targets[arm]};
+    }
+  }
+
+  while (compiler->nbytes % _Alignof(CaseTable))
+    add_bytes(compiler, (const uint8_t *)"", 1);
+
+  uint32_t offset = compiler->nbytes;
+  CaseTable table = {nslots, nglobs, default_target};
+  add_bytes(compiler, (const uint8_t *)&table, sizeof(table));
+  add_bytes(compiler, (const uint8_t *)slots, nslots * sizeof(CaseSlot));
+  add_bytes(compiler, (const uint8_t *)globs, nglobs * sizeof(CaseGlob));
+  add_bytes(compiler, (const uint8_t *)"", 1);
+
+  free(slots);
+  free(globs);
+  return offset;
+}
+
+static void compile_case_ordered(Compiler *compiler, ASTCaseCond *casecond) {
+  uint32_t ends = NO_PATCH;
+
+  for (struct ASTCasePair *pair = casecond->pairs; pair; pair = pair->next) {
+    ASTPattern *clause = pair->clauses;
+    uint32_t matched = NO_PATCH;
+
+    /* Every alternative but the last jumps straight into the body. */
+    for (; clause->alternative; clause = clause->alternative) {
+      emit(compiler, INSN_CaseMatch, 0, 0, add_glob(compiler, clause));
+      matched = emit(compiler, INSN_JumpIf, JUMP_IfSuccess, 0, matched);
+    }
+    emit(compiler, INSN_CaseMatch, 0, 0, add_glob(compiler, clause));
+    uint32_t skip = emit(compiler, INSN_JumpIf, JUMP_IfFailure, 0, 0);
+    patch_chain(compiler, matched, here(compiler));
+    compile_compound_list(compiler, pair->body);
+    ends = emit(compiler, INSN_Jump, 0, 0, ends);
+    patch(compiler, skip, here(compiler));
+  }
+
+  patch_chain(compiler, ends, here(compiler));
+}
+
+static void compile_case_dispatch(Compiler *compiler, ASTCaseCond *casecond,
+                                  uint32_t narms, uint32_t nliterals,
+                                  uint32_t npatterns) {
+  uint32_t *targets = malloc(narms * sizeof(uint32_t));
+
+  if (targets == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t dispatch = emit(compiler, INSN_CaseDispatch, 0, 0, 0);
+  uint32_t ends = NO_PATCH;
+  uint32_t arm = 0;
+
+  for (struct ASTCasePair *pair = casecond->pairs; pair; pair = pair->next) {
+    targets[arm++] = here(compiler);
+    compile_compound_list(compiler, pair->body);
+    ends = emit(compiler, INSN_Jump, 0, 0, ends);
+  }
+
+  uint32_t end = here(compiler);
+  patch_chain(compiler, ends, end);
+  patch(compiler, dispatch,
+        add_case_table(compiler, casecond, targets, nliterals, npatterns,
+                       end));
+  free(targets);
+}
+
+static void compile_case(Compiler *compiler, ASTCaseCond *casecond) {
+  uint32_t narms = 0;
+  uint32_t nliterals = 0;
+  uint32_t npatterns = 0;
+
+  for (struct ASTCasePair *pair = casecond->pairs; pair; pair = pair->next) {
+    narms++;
+    for (ASTPattern *clause = pair->clauses; clause;
+         clause = clause->alternative) {
+      npatterns++;
+      if (pattern_is_literal(clause))
+        nliterals++;
+    }
+  }
+
+  compile_word(compiler, casecond->discrim);
+  emit(compiler, INSN_CaseSubject, 0, 0, 0);
+
+  if (nliterals)
+    compile_case_dispatch(compiler, casecond, narms, nliterals, npatterns);
+  else
+    compile_case_ordered(compiler, casecond);
+
+  emit(compiler, INSN_CaseEnd, 0, 0, 0);
+}
+
+static void compile_compound_node(Compiler *compiler, ASTCompound *compound) {
+  switch (compound->kind) {
+  case COMPOUND_List:
+    compile_lists(compiler, compound->v_list);
+    break;
+  case COMPOUND_SimpleCommand:
+    compile_simple_command(compiler, compound->v_simplecmd);
+    emit(compiler, INSN_Spawn, 0, 0, 0);
+    break;
+  case COMPOUND_Pipeline:
+    compile_pipeline(compiler, compound->v_pipeline);
+    break;
+  case COMPOUND_Group:
+    compile_compound_list(compiler, compound->v_compoundlist);
+    break;
+  case COMPOUND_Subshell: {
+    uint32_t subshell = emit(compiler, INSN_Subshell, 0, 0, 0);
+    compile_compound_list(compiler, compound->v_compoundlist);
+    emit(compiler, INSN_Exit, 0, 0, 0);
+    patch(compiler, subshell, here(compiler));
+    break;
+  }
+  case COMPOUND_ForLoop:
+    compile_for(compiler, compound->v_forloop);
+    break;
+  case COMPOUND_CaseCond:
+    compile_case(compiler, compound->v_casecond);
+    break;
+  case COMPOUND_IfCond:
+    compile_if(compiler, compound->v_ifcond);
+    break;
+  case COMPOUND_WhileLoop:
+    compile_while(compiler, compound->v_whileloop->cond,
+                  compound->v_whileloop->body, JUMP_IfFailure);
+    break;
+  case COMPOUND_UntilLoop:
+    compile_while(compiler, compound->v_untilloop->cond,
+                  compound->v_untilloop->body, JUMP_IfSuccess);
+    break;
+  }
+}
+
+static Program *finish_program(Compiler *compiler) {
+  emit(compiler, INSN_Halt, 0, 0, 0);
+
+  size_t size = PROGRAM_ALIGN(sizeof(Program));
+  uint32_t code_offset = size;
+  size += PROGRAM_ALIGN(compiler->ncode * sizeof(Instr));
+  uint32_t bytes_offset = size;
+  size += compiler->nbytes;
+
+  Program *program = malloc(size);
+
+  if (program == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  program->size = size;
+  program->ncode = compiler->ncode;
+  program->nbytes = compiler->nbytes;
+  program->code_offset = code_offset;
+  program->bytes_offset = bytes_offset;
+  memcpy(program_code(program), compiler->code,
+         compiler->ncode * sizeof(Instr));
+  if (compiler->nbytes)
+    memcpy((char *)program + bytes_offset, compiler->bytes, compiler->nbytes);
+
+  free(compiler->code);
+  free(compiler->bytes);
+  return program;
+}
+
+Program *compile_compound(ASTCompound *compound) {
+  Compiler compiler = {0};
+  for (; compound; compound = compound->next)
+    compile_compound_node(&compiler, compound);
+  return finish_program(&compiler);
+}
+
+void delete_program(Program *program) { free(program); }
+
+void dump_program(const Program *program) {
+  static const char *names[INSN_Count] = {
+      [INSN_Halt] = "halt",         [INSN_Load] = "load",
+      [INSN_Begin] = "begin",       [INSN_AppendText] = "append-text",
+      [INSN_AppendParam] = "append-param",
+      [INSN_AppendTilde] = "append-tilde",
+      [INSN_AppendArith] = "append-arith",
+      [INSN_End] = "end",           [INSN_Arg] = "arg",
+      [INSN_Assign] = "assign",
+      [INSN_Redirect] = "redirect", [INSN_Pipe] = "pipe",
+      [INSN_Spawn] = "spawn",       [INSN_Jump] = "jump",
+      [INSN_JumpIf] = "jump-if",    [INSN_ForInit] = "for-init",
+      [INSN_ForItem] = "for-item",  [INSN_ForNext] = "for-next",
+      [INSN_CaseSubject] = "case-subject",
+      [INSN_CaseMatch] = "case-match",
+      [INSN_CaseDispatch] = "case-dispatch",
+      [INSN_CaseEnd] = "case-end",  [INSN_Subshell] = "subshell",
+      [INSN_Exit] = "exit",
+  };
+  Instr *code = program_code(program);
+
+  for (uint32_t i = 0; i < program->ncode; i++) {
+    Instr *instr = &code[i];
+    printf("%4u  %-14s %3u %4d %6u", i, names[instr->op], instr->flags,
+           instr->fno, instr->arg);
+    if (instr->op == INSN_Load || instr->op == INSN_AppendText ||
+        instr->op == INSN_ForInit || instr->op == INSN_Assign ||
+        (instr->op == INSN_AppendParam && instr->flags == PARAM_ShellVariable))
+      printf("  \"%s\"", program_text(program, instr->arg));
+    printf("\n");
+  }
+}
+
+static bool verify_case_table(const Program *program, uint32_t offset) {
+  if (offset % _Alignof(CaseTable) || program->nbytes < sizeof(CaseTable) ||
+      offset > program->nbytes - sizeof(CaseTable))
+    return false;
+
+  const CaseTable *table =
+      (const CaseTable *)program_text(program, offset);
+  size_t available = program->nbytes - offset - sizeof(CaseTable);
+
+  if (table->nslots == 0 || table->nslots & (table->nslots - 1) ||
+      table->nslots > available / sizeof(CaseSlot) ||
+      table->nglobs > (available - table->nslots * sizeof(CaseSlot)) /
+                          sizeof(CaseGlob) ||
+      table->default_target >= program->ncode)
+    return false;
+
+  const CaseSlot *slots = case_slots(table);
+  bool has_empty = false;
+
+  for (uint32_t i = 0; i < table->nslots; i++) {
+    if (slots[i].key == CASE_EMPTY) {
+      has_empty = true;
+      continue;
+    }
+    if (slots[i].key >= program->nbytes ||
+        slots[i].length >= program->nbytes - slots[i].key ||
+        slots[i].target >= program->ncode)
+      return false;
+  }
+
+  const CaseGlob *globs = case_globs(table);
+
+  for (uint32_t i = 0; i < table->nglobs; i++)
+    if (globs[i].glob >= program->nbytes || globs[i].target >= program->ncode ||
+        !glob_verify((const uint8_t *)program_text(program, globs[i].glob),
+                     program->nbytes - globs[i].glob))
+      return false;
+
+  return has_empty;
+}
+
+typedef struct NestFlow {
+  int32_t *loops;
+  int32_t *subjects;
+  uint32_t *pending;
+  uint32_t npending;
+} NestFlow;
+
+static bool nest_flow_to(NestFlow *flow, uint32_t target, int32_t loops,
+                         int32_t subjects) {
+  if (loops < 0 || subjects < 0)
+    return false;
+
+  if (flow->loops[target] < 0) {
+    flow->loops[target] = loops;
+    flow->subjects[target] = subjects;
+    flow->pending[flow->npending++] = target;
+    return true;
+  }
+
+  return flow->loops[target] == loops && flow->subjects[target] == subjects;
+}
+
+/* Every path must reach an instruction with the same loop and case-subject
+ * depth, so jumps cannot skip a ForInit or CaseSubject and Halt is only
+ * reached with both stacks empty. */
+static bool verify_nesting(const Program *program) {
+  Instr *code = program_code(program);
+  NestFlow flow = {
+      .loops = malloc(program->ncode * sizeof(int32_t)),
+      .subjects = malloc(program->ncode * sizeof(int32_t)),
+      .pending = malloc(program->ncode * sizeof(uint32_t)),
+  };
+
+  if (flow.loops == NULL || flow.subjects == NULL || flow.pending == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t i = 0; i < program->ncode; i++)
+    flow.loops[i] = -1;
+
+  bool ok = nest_flow_to(&flow, 0, 0, 0);
+
+  while (ok && flow.npending > 0) {
+    uint32_t i = flow.pending[--flow.npending];
+    Instr *instr = &code[i];
+    int32_t loops = flow.loops[i];
+    int32_t subjects = flow.subjects[i];
+    uint32_t next = i + 1;
+
+    switch (instr->op) {
+    case INSN_Halt:
+      ok = loops == 0 && subjects == 0;
+      continue;
+    case INSN_Exit:
+      continue;
+    case INSN_Jump:
+      ok = nest_flow_to(&flow, instr->arg, loops, subjects);
+      continue;
+    case INSN_JumpIf:
+    case INSN_Subshell:
+      ok = nest_flow_to(&flow, instr->arg, loops, subjects);
+      break;
+    case INSN_ForInit:
+      loops++;
+      break;
+    case INSN_ForItem:
+      ok = loops > 0;
+      break;
+    case INSN_ForNext:
+      ok = nest_flow_to(&flow, instr->arg, loops - 1, subjects);
+      break;
+    case INSN_CaseSubject:
+      subjects++;
+      break;
+    case INSN_CaseMatch:
+      ok = subjects > 0;
+      break;
+    case INSN_CaseEnd:
+      subjects--;
+      break;
+    case INSN_CaseDispatch: {
+      const CaseTable *table =
+          (const CaseTable *)program_text(program, instr->arg);
+      const CaseSlot *slots = case_slots(table);
+      const CaseGlob *globs = case_globs(table);
+
+      ok = subjects > 0 &&
+           nest_flow_to(&flow, table->default_target, loops, subjects);
+      for (uint32_t j = 0; ok && j < table->nslots; j++)
+        if (slots[j].key != CASE_EMPTY)
+          ok = nest_flow_to(&flow, slots[j].target, loops, subjects);
+      for (uint32_t j = 0; ok && j < table->nglobs; j++)
+        ok = nest_flow_to(&flow, globs[j].target, loops, subjects);
+      continue;
+    }
+    default:
+      break;
+    }
+
+    if (ok && next < program->ncode)
+      ok = nest_flow_to(&flow, next, loops, subjects);
+  }
+
+  free(flow.loops);
+  free(flow.subjects);
+  free(flow.pending);
+  return ok;
+}
+
+bool verify_program(const Program *program, size_t size) {
+  if (size < sizeof(Program) || program->size != size ||
+      program->code_offset < sizeof(Program) ||
+      program->code_offset % _Alignof(Instr) ||
+      program->code_offset > size || program->ncode == 0 ||
+      program->ncode > (size - program->code_offset) / sizeof(Instr) ||
+      program->bytes_offset <
+          program->code_offset + program->ncode * sizeof(Instr) ||
+      program->bytes_offset > size ||
+      program->nbytes != size - program->bytes_offset)
+    return false;
+
+  if (program->nbytes && program_text(program, program->nbytes - 1)[0] != '\0')
+    return false;
+
+  Instr *code = program_code(program);
+
+  if (code[program->ncode - 1].op != INSN_Halt)
+    return false;
+
+  for (uint32_t i = 0; i < program->ncode; i++) {
+    Instr *instr = &code[i];
+
+    switch (instr->op) {
+    case INSN_Load:
+    case INSN_AppendText:
+    case INSN_AppendTilde:
+    case INSN_ForInit:
+    case INSN_Assign:
+      if (instr->arg >= program->nbytes)
+        return false;
+      break;
+    case INSN_AppendParam:
+      if (instr->flags == PARAM_ShellVariable &&
+          instr->arg >= program->nbytes)
+        return false;
+      break;
+    case INSN_CaseMatch:
+      if (instr->arg >= program->nbytes ||
+          !glob_verify((const uint8_t *)program_text(program, instr->arg),
+                       program->nbytes - instr->arg))
+        return false;
+      break;
+    case INSN_AppendArith:
+      if (instr->arg % ARITH_ALIGN || instr->arg >= program->nbytes ||
+          !arith_verify(
+              (const ArithProgram *)program_text(program, instr->arg),
+              program->nbytes - instr->arg))
+        return false;
+      break;
+    case INSN_CaseDispatch:
+      if (!verify_case_table(program, instr->arg))
+        return false;
+      break;
+    case INSN_Jump:
+    case INSN_JumpIf:
+    case INSN_ForNext:
+    case INSN_Subshell:
+      if (instr->arg >= program->ncode)
+        return false;
+      break;
+    default:
+      if (instr->op >= INSN_Count)
+        return false;
+      break;
+    }
+  }
+
+  return verify_nesting(program);
+}
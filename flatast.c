@@ -0,0 +1,299 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "absyn.h"
+#include "flatast.h"
+
+#define FLAT_ALIGN(n) (((n) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+
+typedef struct FlatBuilder {
+  FlatAST *ast;
+  uint32_t list;
+  uint32_t pipeline;
+  uint32_t command;
+  uint32_t word;
+  uint32_t byte;
+} FlatBuilder;
+
+typedef struct FlatSink {
+  char *bytes;
+  uint32_t length;
+} FlatSink;
+
+/* Words are flattened to their source spelling; with a NULL sink buffer the
+ * renderers only measure. */
+static void sink_bytes(FlatSink *sink, const void *bytes, size_t length) {
+  if (sink->bytes && length)
+    memcpy(&sink->bytes[sink->length], bytes, length);
+  sink->length += length;
+}
+
+static void sink_string(FlatSink *sink, const char *text) {
+  sink_bytes(sink, text, strlen(text));
+}
+
+static void sink_buffer(FlatSink *sink, ASTBuffer *buffer) {
+  if (buffer)
+    sink_bytes(sink, buffer->buffer, buffer->length);
+}
+
+static void render_word(FlatSink *sink, ASTWord *word);
+
+static void render_pattern(FlatSink *sink, ASTPattern *pattern) {
+  for (; pattern; pattern = pattern->next) {
+    switch (pattern->kind) {
+    case PATT_AnyString:
+      sink_string(sink, "*");
+      break;
+    case PATT_AnyChar:
+      sink_string(sink, "?");
+      break;
+    case PATT_Bracket:
+      sink_string(sink, pattern->v_bracket->negate ? "[!" : "[");
+      for (ASTCharRange *range = pattern->v_bracket->ranges; range;
+           range = range->next) {
+        char text[3] = {range->start, '-', range->end};
+        sink_bytes(sink, text, range->start == range->end ? 1 : 3);
+      }
+      sink_string(sink, "]");
+      break;
+    case PATT_Literal:
+      sink_buffer(sink, pattern->v_literal);
+      break;
+    }
+  }
+}
+
+static void render_factor(FlatSink *sink, ASTFactor *factor) {
+  static const char *operators[] = {
+      [OP_Add] = " + ", [OP_Sub] = " - ",   [OP_Mul] = " * ", [OP_Div] = " / ",
+      [OP_Mod] = " % ", [OP_Shr] = " >> ", [OP_Shl] = " << ",
+  };
+  char number[32];
+
+  switch (factor->kind) {
+  case FACT_Number:
+    snprintf(number, sizeof(number), "%jd", factor->v_number);
+    sink_string(sink, number);
+    break;
+  case FACT_Variable:
+    sink_buffer(sink, factor->v_variable);
+    break;
+  case FACT_ArithExpr:
+    sink_string(sink, "(");
+    render_factor(sink, factor->v_arithexpr->left);
+    sink_string(sink, operators[factor->v_arithexpr->op]);
+    render_factor(sink, factor->v_arithexpr->right);
+    sink_string(sink, ")");
+    break;
+  }
+}
+
+static void render_param(FlatSink *sink, ASTParamExpn *expn) {
+  ASTParam *param = expn->param;
+  char text[16];
+
+  switch (param->kind) {
+  case PARAM_ShellVariable:
+    sink_string(sink, "${");
+    sink_buffer(sink, param->v_variable);
+    sink_buffer(sink, expn->punct);
+    if (expn->word)
+      render_word(sink, expn->word);
+    sink_string(sink, "}");
+    break;
+  case PARAM_Special:
+    snprintf(text, sizeof(text), "$%c", param->v_special);
+    sink_string(sink, text);
+    break;
+  case PARAM_Positional:
+    snprintf(text, sizeof(text), "${%d}", param->v_positional);
+    sink_string(sink, text);
+    break;
+  }
+}
+
+static void render_wordexpn(FlatSink *sink, ASTWordExpn *expn) {
+  for (; expn; expn = expn->next) {
+    switch (expn->kind) {
+    case WEXPN_Text:
+      sink_buffer(sink, expn->v_buffer);
+      break;
+    case WEXPN_TildeExpn:
+      sink_string(sink, "~");
+      sink_buffer(sink, expn->v_buffer);
+      break;
+    case WEXPN_ParamExpn:
+      render_param(sink, expn->v_paramexpn);
+      break;
+    case WEXPN_CommandSubst:
+      sink_string(sink, "$(...)");
+      break;
+    case WEXPN_ArithExpr: {
+      ASTFactor root = {.kind = FACT_ArithExpr,
+                        .v_arithexpr = expn->v_arithexpr};
+      sink_string(sink, "$(");
+      render_factor(sink, &root);
+      sink_string(sink, ")");
+      break;
+    }
+    case WEXPN_Pattern:
+      render_pattern(sink, expn->v_pattern);
+      break;
+    }
+  }
+}
+
+static void render_word(FlatSink *sink, ASTWord *word) {
+  switch (word->kind) {
+  case WORD_Buffer:
+    sink_buffer(sink, word->v_buffer);
+    break;
+  case WORD_QString:
+    sink_string(sink, "'");
+    sink_buffer(sink, word->v_buffer);
+    sink_string(sink, "'");
+    break;
+  case WORD_Redir:
+    sink_buffer(sink, word->v_redir->subj);
+    break;
+  case WORD_WordExpn:
+    render_wordexpn(sink, word->v_wordexpn);
+    break;
+  case WORD_String:
+    sink_string(sink, "\"");
+    render_wordexpn(sink, word->v_wordexpn);
+    sink_string(sink, "\"");
+    break;
+  case WORD_Pattern:
+    render_pattern(sink, word->v_pattern);
+    break;
+  case WORD_Assign:
+    sink_buffer(sink, word->v_assign->name);
+    sink_string(sink, "=");
+    if (word->v_assign->value)
+      render_word(sink, word->v_assign->value);
+    break;
+  }
+}
+
+static void count_ast(FlatAST *ast, ASTList *lists) {
+  for (ASTList *list = lists; list; list = list->next) {
+    ast->nlists++;
+    for (ASTPipeline *pipeline = list->commands; pipeline;
+         pipeline = pipeline->next) {
+      ast->npipelines++;
+      for (ASTSimpleCommand *cmd = pipeline->commands; cmd; cmd = cmd->next) {
+        ast->ncommands++;
+        for (ASTWord *word = cmd->argv; word; word = word->next) {
+          FlatSink sink = {NULL, 0};
+          render_word(&sink, word);
+          ast->nwords++;
+          ast->nbytes += sink.length + 1;
+        }
+      }
+    }
+  }
+}
+
+static void flat_add_word(FlatBuilder *builder, ASTWord *word) {
+  FlatWord *flat = &flat_words(builder->ast)[builder->word++];
+  flat->kind = word->kind;
+  flat->redir_kind = 0;
+  flat->fno = -1;
+
+  if (word->kind == WORD_Redir) {
+    flat->redir_kind = word->v_redir->kind;
+    flat->fno = word->v_redir->fno;
+  }
+
+  FlatSink sink = {(char *)builder->ast + builder->ast->bytes_offset,
+                   builder->byte};
+  render_word(&sink, word);
+  sink.bytes[sink.length] = '\0';
+  flat->text = (FlatSpan){builder->byte, sink.length - builder->byte};
+  builder->byte = sink.length + 1;
+}
+
+static void flat_add_command(FlatBuilder *builder, ASTSimpleCommand *cmd) {
+  FlatCommand *flat = &flat_commands(builder->ast)[builder->command++];
+  flat->words.first = builder->word;
+  flat->words.count = 0;
+
+  for (ASTWord *word = cmd->argv; word; word = word->next) {
+    flat_add_word(builder, word);
+    flat->words.count++;
+  }
+}
+
+static void flat_add_pipeline(FlatBuilder *builder, ASTPipeline *pipeline) {
+  FlatPipeline *flat = &flat_pipelines(builder->ast)[builder->pipeline++];
+  flat->sep = pipeline->sep;
+  flat->term = pipeline->term;
+  flat->commands.first = builder->command;
+  flat->commands.count = 0;
+
+  for (ASTSimpleCommand *cmd = pipeline->commands; cmd; cmd = cmd->next) {
+    flat_add_command(builder, cmd);
+    flat->commands.count++;
+  }
+}
+
+FlatAST *flatten_ast(ASTList *lists) {
+  FlatAST counts = {0};
+  count_ast(&counts, lists);
+
+  size_t size = FLAT_ALIGN(sizeof(FlatAST));
+  counts.lists_offset = size;
+  size += FLAT_ALIGN(counts.nlists * sizeof(FlatList));
+  counts.pipelines_offset = size;
+  size += FLAT_ALIGN(counts.npipelines * sizeof(FlatPipeline));
+  counts.commands_offset = size;
+  size += FLAT_ALIGN(counts.ncommands * sizeof(FlatCommand));
+  counts.words_offset = size;
+  size += FLAT_ALIGN(counts.nwords * sizeof(FlatWord));
+  counts.bytes_offset = size;
+  size += counts.nbytes;
+  counts.size = size;
+
+  FlatAST *ast = malloc(size);
+
+  if (ast == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  *ast = counts;
+  FlatBuilder builder = {ast, 0, 0, 0, 0, 0};
+
+  for (ASTList *list = lists; list; list = list->next) {
+    FlatList *flat = &flat_lists(ast)[builder.list++];
+    flat->pipelines.first = builder.pipeline;
+    flat->pipelines.count = 0;
+
+    for (ASTPipeline *pipeline = list->commands; pipeline;
+         pipeline = pipeline->next) {
+      flat_add_pipeline(&builder, pipeline);
+      flat->pipelines.count++;
+    }
+  }
+
+  return ast;
+}
+
+FlatAST *copy_flat_ast(const FlatAST *ast) {
+  FlatAST *copy = malloc(ast->size);
+
+  if (copy == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return memcpy(copy, ast, ast->size);
+}
+
+void delete_flat_ast(FlatAST *ast) { free(ast); }
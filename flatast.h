@@ -0,0 +1,75 @@
+#ifndef FLATAST_H
+#define FLATAST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absyn.h"
+
+#define FLAT_NONE UINT32_MAX
+
+typedef struct FlatSpan {
+  uint32_t first;
+  uint32_t count;
+} FlatSpan;
+
+typedef struct FlatWord {
+  uint8_t kind;
+  uint8_t redir_kind;
+  int16_t fno;
+  FlatSpan text;
+} FlatWord;
+
+typedef struct FlatCommand {
+  FlatSpan words;
+} FlatCommand;
+
+typedef struct FlatPipeline {
+  uint8_t sep;
+  uint8_t term;
+  FlatSpan commands;
+} FlatPipeline;
+
+typedef struct FlatList {
+  FlatSpan pipelines;
+} FlatList;
+
+typedef struct FlatAST {
+  size_t size;
+  uint32_t nlists;
+  uint32_t npipelines;
+  uint32_t ncommands;
+  uint32_t nwords;
+  uint32_t nbytes;
+  uint32_t lists_offset;
+  uint32_t pipelines_offset;
+  uint32_t commands_offset;
+  uint32_t words_offset;
+  uint32_t bytes_offset;
+} FlatAST;
+
+static inline FlatList *flat_lists(const FlatAST *ast) {
+  return (FlatList *)((uint8_t *)ast + ast->lists_offset);
+}
+
+static inline FlatPipeline *flat_pipelines(const FlatAST *ast) {
+  return (FlatPipeline *)((uint8_t *)ast + ast->pipelines_offset);
+}
+
+static inline FlatCommand *flat_commands(const FlatAST *ast) {
+  return (FlatCommand *)((uint8_t *)ast + ast->commands_offset);
+}
+
+static inline FlatWord *flat_words(const FlatAST *ast) {
+  return (FlatWord *)((uint8_t *)ast + ast->words_offset);
+}
+
+static inline const char *flat_text(const FlatAST *ast, FlatSpan span) {
+  return (const char *)ast + ast->bytes_offset + span.first;
+}
+
+FlatAST *flatten_ast(ASTList *lists);
+FlatAST *copy_flat_ast(const FlatAST *ast);
+void delete_flat_ast(FlatAST *ast);
+
+#endif
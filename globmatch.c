@@ -0,0 +1,412 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "absyn.h"
+#include "globmatch.h"
+
+#define NO_LITERAL SIZE_MAX
+#define STAR_SIZE 5
+
+typedef struct GlobBuilder {
+  uint8_t *code;
+  size_t length;
+  size_t capacity;
+  size_t literal;
+  size_t star;
+  uint32_t width;
+  GlobHeader header;
+} GlobBuilder;
+
+static void builder_reserve(GlobBuilder *builder, size_t length) {
+  if (builder->length + length <= builder->capacity)
+    return;
+
+  size_t capacity = builder->capacity ? builder->capacity : 64;
+  while (capacity < builder->length + length)
+    capacity *= 2;
+
+  builder->code = realloc(builder->code, capacity);
+
+  if (builder->code == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  builder->capacity = capacity;
+}
+
+static void builder_init(GlobBuilder *builder) {
+  *builder = (GlobBuilder){NULL, 0, 0, NO_LITERAL, 0, 0, {0}};
+  builder_reserve(builder, GLOB_HEADER_SIZE);
+  builder->length = GLOB_HEADER_SIZE;
+}
+
+static void emit_literal(GlobBuilder *builder, uint8_t ch) {
+  if (builder->literal == NO_LITERAL ||
+      builder->code[builder->literal + 1] == GLOB_LITERAL_MAX) {
+    builder_reserve(builder, 2);
+    builder->literal = builder->length;
+    builder->code[builder->length++] = GLOB_Literal;
+    builder->code[builder->length++] = 0;
+  }
+
+  builder_reserve(builder, 1);
+  builder->code[builder->length++] = ch;
+  builder->code[builder->literal + 1]++;
+  builder->width++;
+}
+
+static void emit_any(GlobBuilder *builder) {
+  builder_reserve(builder, 1);
+  builder->code[builder->length++] = GLOB_Any;
+  builder->literal = NO_LITERAL;
+  builder->width++;
+}
+
+static void emit_class(GlobBuilder *builder, const uint8_t *bitmap) {
+  builder_reserve(builder, 1 + GLOB_CLASS_SIZE);
+  builder->code[builder->length++] = GLOB_Class;
+  memcpy(&builder->code[builder->length], bitmap, GLOB_CLASS_SIZE);
+  builder->length += GLOB_CLASS_SIZE;
+  builder->literal = NO_LITERAL;
+  builder->width++;
+}
+
+static void close_segment(GlobBuilder *builder) {
+  if (builder->star)
+    memcpy(&builder->code[builder->star + 1], &builder->width,
+           sizeof(uint32_t));
+  else
+    builder->header.prefix_width = builder->width;
+
+  builder->header.min_length += builder->width;
+  builder->width = 0;
+}
+
+static void emit_star(GlobBuilder *builder) {
+  builder->literal = NO_LITERAL;
+  if (builder->star && builder->star + STAR_SIZE == builder->length)
+    return;
+
+  close_segment(builder);
+  builder_reserve(builder, STAR_SIZE);
+  builder->star = builder->length;
+  builder->code[builder->length] = GLOB_Star;
+  memset(&builder->code[builder->length + 1], 0, sizeof(uint32_t));
+  builder->length += STAR_SIZE;
+}
+
+static uint8_t *builder_finish(GlobBuilder *builder, size_t *size) {
+  uint32_t width = builder->width;
+  close_segment(builder);
+
+  if (builder->star) {
+    builder->header.tail = builder->star + STAR_SIZE;
+    builder->header.tail_width = width;
+  }
+
+  builder_reserve(builder, 1);
+  builder->code[builder->length++] = GLOB_End;
+  builder->header.size = builder->length;
+  memcpy(builder->code, &builder->header, GLOB_HEADER_SIZE);
+
+  *size = builder->length;
+  return builder->code;
+}
+
+static void set_range(uint8_t *bitmap, uint8_t start, uint8_t end) {
+  for (unsigned ch = start; ch <= end; ch++)
+    bitmap[ch >> 3] |= 1 << (ch & 7);
+}
+
+static void negate_class(uint8_t *bitmap) {
+  for (size_t i = 0; i < GLOB_CLASS_SIZE; i++)
+    bitmap[i] = ~bitmap[i];
+}
+
+static size_t compile_bracket(GlobBuilder *builder, const char *pattern,
+                              size_t length, size_t i) {
+  uint8_t bitmap[GLOB_CLASS_SIZE] = {0};
+  bool negate = false;
+  size_t start = i;
+
+  if (i < length && (pattern[i] == '!' || pattern[i] == '^')) {
+    negate = true;
+    i++;
+  }
+
+  for (bool first = true; i < length && (first || pattern[i] != ']');
+       first = false) {
+    uint8_t low = pattern[i++];
+    if (low == '\\' && i < length)
+      low = pattern[i++];
+
+    uint8_t high = low;
+    if (i + 1 < length && pattern[i] == '-' && pattern[i + 1] != ']') {
+      high = pattern[i + 1];
+      i += 2;
+      if (high == '\\' && i < length)
+        high = pattern[i++];
+    }
+
+    if (low <= high)
+      set_range(bitmap, low, high);
+  }
+
+  if (i >= length) {
+    emit_literal(builder, '[');
+    return start;
+  }
+
+  if (negate)
+    negate_class(bitmap);
+  emit_class(builder, bitmap);
+  return i + 1;
+}
+
+uint8_t *glob_compile(const char *pattern, size_t length, size_t *size) {
+  GlobBuilder builder;
+  builder_init(&builder);
+
+  for (size_t i = 0; i < length;) {
+    switch (pattern[i]) {
+    case '*':
+      emit_star(&builder);
+      i++;
+      break;
+    case '?':
+      emit_any(&builder);
+      i++;
+      break;
+    case '[':
+      i = compile_bracket(&builder, pattern, length, i + 1);
+      break;
+    case '\\':
+      if (i + 1 < length)
+        i++;
+      emit_literal(&builder, pattern[i++]);
+      break;
+    default:
+      emit_literal(&builder, pattern[i++]);
+      break;
+    }
+  }
+
+  return builder_finish(&builder, size);
+}
+
+const uint8_t *glob_compile_pattern(ASTPattern *pattern) {
+  if (pattern->glob)
+    return pattern->glob;
+
+  GlobBuilder builder;
+  builder_init(&builder);
+
+  for (ASTPattern *node = pattern; node; node = node->next) {
+    switch (node->kind) {
+    case PATT_AnyString:
+      emit_star(&builder);
+      break;
+    case PATT_AnyChar:
+      emit_any(&builder);
+      break;
+    case PATT_Bracket: {
+      uint8_t bitmap[GLOB_CLASS_SIZE] = {0};
+      for (ASTCharRange *range = node->v_bracket->ranges; range;
+           range = range->next)
+        if ((uint8_t)range->start <= (uint8_t)range->end)
+          set_range(bitmap, range->start, range->end);
+      if (node->v_bracket->negate)
+        negate_class(bitmap);
+      emit_class(&builder, bitmap);
+      break;
+    }
+    case PATT_Literal:
+      for (size_t i = 0; i < node->v_literal->length; i++)
+        emit_literal(&builder, node->v_literal->buffer[i]);
+      break;
+    }
+  }
+
+  size_t size;
+  uint8_t *code = builder_finish(&builder, &size);
+  uint8_t *glob = ast_arena_alloc(size);
+  memcpy(glob, code, size);
+  free(code);
+
+  pattern->glob = glob;
+  return glob;
+}
+
+static GlobHeader read_header(const uint8_t *glob) {
+  GlobHeader header;
+  memcpy(&header, glob, GLOB_HEADER_SIZE);
+  return header;
+}
+
+size_t glob_size(const uint8_t *glob) { return read_header(glob).size; }
+
+static uint32_t star_width(const uint8_t *op) {
+  uint32_t width;
+  memcpy(&width, op + 1, sizeof(uint32_t));
+  return width;
+}
+
+static const uint8_t *skip_segment(const uint8_t *op) {
+  for (;;) {
+    switch (*op) {
+    case GLOB_Literal:
+      op += 2 + op[1];
+      break;
+    case GLOB_Any:
+      op++;
+      break;
+    case GLOB_Class:
+      op += 1 + GLOB_CLASS_SIZE;
+      break;
+    default:
+      return op;
+    }
+  }
+}
+
+static bool match_segment(const uint8_t *op, const uint8_t *subject) {
+  for (;;) {
+    switch (*op) {
+    case GLOB_Literal:
+      if (memcmp(subject, op + 2, op[1]))
+        return false;
+      subject += op[1];
+      op += 2 + op[1];
+      break;
+    case GLOB_Any:
+      subject++;
+      op++;
+      break;
+    case GLOB_Class:
+      if (!(op[1 + (*subject >> 3)] & (1 << (*subject & 7))))
+        return false;
+      subject++;
+      op += 1 + GLOB_CLASS_SIZE;
+      break;
+    default:
+      return true;
+    }
+  }
+}
+
+bool glob_match(const uint8_t *glob, const char *subject, size_t length) {
+  GlobHeader header = read_header(glob);
+  const uint8_t *text = (const uint8_t *)subject;
+  const uint8_t *op = glob + GLOB_HEADER_SIZE;
+
+  if (length < header.min_length)
+    return false;
+  if (header.tail == 0)
+    return length == header.min_length && match_segment(op, text);
+
+  /* Every segment between stars has a fixed width, so anchoring the prefix
+   * and tail and taking the leftmost fit for each middle segment is exact;
+   * no backtracking is needed. */
+  size_t end = length - header.tail_width;
+  const uint8_t *tail = glob + header.tail;
+
+  if (!match_segment(op, text) || !match_segment(tail, text + end))
+    return false;
+
+  size_t position = header.prefix_width;
+  op = skip_segment(op);
+
+  while (op + STAR_SIZE != tail) {
+    uint32_t width = star_width(op);
+    const uint8_t *segment = op + STAR_SIZE;
+
+    for (;;) {
+      if (position + width > end)
+        return false;
+
+      if (*segment == GLOB_Literal) {
+        const uint8_t *found =
+            memchr(text + position, segment[2], end - width - position + 1);
+        if (found == NULL)
+          return false;
+        position = found - text;
+      }
+
+      if (match_segment(segment, text + position))
+        break;
+      position++;
+    }
+
+    position += width;
+    op = skip_segment(segment);
+  }
+
+  return true;
+}
+
+bool glob_verify(const uint8_t *glob, size_t size) {
+  if (size < GLOB_HEADER_SIZE + 1)
+    return false;
+
+  GlobHeader header = read_header(glob);
+  if (header.size < GLOB_HEADER_SIZE + 1 || header.size > size ||
+      glob[header.size - 1] != GLOB_End)
+    return false;
+
+  GlobHeader actual = {header.size, 0, 0, 0, 0};
+  uint32_t width = 0;
+  size_t star = 0;
+
+  for (size_t i = GLOB_HEADER_SIZE; i < header.size - 1;) {
+    switch (glob[i]) {
+    case GLOB_Literal:
+      if (i + 2 > header.size - 1 || glob[i + 1] == 0 ||
+          i + 2 + glob[i + 1] > header.size - 1)
+        return false;
+      width += glob[i + 1];
+      i += 2 + glob[i + 1];
+      break;
+    case GLOB_Any:
+      width++;
+      i++;
+      break;
+    case GLOB_Class:
+      if (i + 1 + GLOB_CLASS_SIZE > header.size - 1)
+        return false;
+      width++;
+      i += 1 + GLOB_CLASS_SIZE;
+      break;
+    case GLOB_Star:
+      if (i + STAR_SIZE > header.size - 1)
+        return false;
+      if (star && star_width(&glob[star]) != width)
+        return false;
+      if (!star)
+        actual.prefix_width = width;
+      actual.min_length += width;
+      width = 0;
+      star = i;
+      i += STAR_SIZE;
+      break;
+    default:
+      return false;
+    }
+  }
+
+  if (star) {
+    if (star_width(&glob[star]) != width)
+      return false;
+    actual.tail = star + STAR_SIZE;
+    actual.tail_width = width;
+  } else {
+    actual.prefix_width = width;
+  }
+  actual.min_length += width;
+
+  return !memcmp(&header, &actual, sizeof(GlobHeader));
+}
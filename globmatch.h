@@ -0,0 +1,36 @@
+#ifndef GLOBMATCH_H
+#define GLOBMATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "absyn.h"
+
+#define GLOB_HEADER_SIZE 20
+#define GLOB_CLASS_SIZE 32
+#define GLOB_LITERAL_MAX 255
+
+enum GlobOp {
+  GLOB_End,
+  GLOB_Literal,
+  GLOB_Any,
+  GLOB_Class,
+  GLOB_Star,
+};
+
+typedef struct GlobHeader {
+  uint32_t size;
+  uint32_t min_length;
+  uint32_t prefix_width;
+  uint32_t tail;
+  uint32_t tail_width;
+} GlobHeader;
+
+uint8_t *glob_compile(const char *pattern, size_t length, size_t *size);
+const uint8_t *glob_compile_pattern(ASTPattern *pattern);
+size_t glob_size(const uint8_t *glob);
+bool glob_match(const uint8_t *glob, const char *subject, size_t length);
+bool glob_verify(const uint8_t *glob, size_t size);
+
+#endif
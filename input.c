@@ -0,0 +1,101 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "input.h"
+
+static void *input_alloc(void *memory, size_t size) {
+  memory = realloc(memory, size);
+
+  if (memory == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return memory;
+}
+
+InputReader *new_input_reader(int fd) {
+  InputReader *reader = input_alloc(NULL, sizeof(InputReader));
+  reader->fd = fd;
+  reader->buffer = input_alloc(NULL, INPUT_BUFFER_SIZE);
+  reader->start = 0;
+  reader->end = 0;
+  reader->capacity = 256;
+  reader->line = input_alloc(NULL, reader->capacity);
+  reader->eof = false;
+  return reader;
+}
+
+void delete_input_reader(InputReader *reader) {
+  free(reader->buffer);
+  free(reader->line);
+  free(reader);
+}
+
+bool input_buffered(InputReader *reader) {
+  return reader->start < reader->end;
+}
+
+static void line_reserve(InputReader *reader, size_t needed) {
+  needed += INPUT_LINE_SLACK;
+  if (needed <= reader->capacity)
+    return;
+
+  size_t capacity = reader->capacity * 2;
+  while (capacity < needed)
+    capacity *= 2;
+  reader->line = input_alloc(reader->line, capacity);
+  reader->capacity = capacity;
+}
+
+static bool input_fill(InputReader *reader) {
+  ssize_t nread;
+
+  do {
+    nread = read(reader->fd, reader->buffer, INPUT_BUFFER_SIZE);
+  } while (nread == -1 && errno == EINTR);
+
+  if (nread <= 0) {
+    reader->eof = true;
+    return false;
+  }
+
+  reader->start = 0;
+  reader->end = nread;
+  return true;
+}
+
+ssize_t input_read_line(InputReader *reader, char **line) {
+  size_t length = 0;
+
+  for (;;) {
+    if (!input_buffered(reader) && (reader->eof || !input_fill(reader))) {
+      if (length == 0)
+        return -1;
+      break;
+    }
+
+    char *chunk = &reader->buffer[reader->start];
+    size_t available = reader->end - reader->start;
+    char *newline = memchr(chunk, '\n', available);
+    size_t take = newline ? (size_t)(newline - chunk) : available;
+
+    line_reserve(reader, length + take);
+    memcpy(&reader->line[length], chunk, take);
+    length += take;
+    reader->start += take;
+
+    if (newline) {
+      reader->start++;
+      break;
+    }
+  }
+
+  reader->line[length] = '\0';
+  *line = reader->line;
+  return length;
+}
@@ -0,0 +1,26 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define INPUT_BUFFER_SIZE (64 * 1024)
+#define INPUT_LINE_SLACK 2
+
+typedef struct InputReader {
+  int fd;
+  char *buffer;
+  size_t start;
+  size_t end;
+  char *line;
+  size_t capacity;
+  bool eof;
+} InputReader;
+
+InputReader *new_input_reader(int fd);
+void delete_input_reader(InputReader *reader);
+bool input_buffered(InputReader *reader);
+ssize_t input_read_line(InputReader *reader, char **line);
+
+#endif
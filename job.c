@@ -1,25 +1,94 @@
+#define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <unistd.h>
 #include <wait.h>
 
 #include "absyn.h"
+#include "bytecode.h"
+#include "cmdhash.h"
 #include "common.h"
+#include "input.h"
 #include "job.h"
 #include "lexer.h"
 #include "memory.h"
 #include "parser.tab.h"
+#include "script.h"
+#include "vars.h"
+
+#define SPAWN_UNSUPPORTED -2
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
 
 bool do_exit = false;
+bool interactive = false;
+int exit_status = 0;
+pid_t last_background = 0;
+ShellOptions shell_options = {false, 0};
 
-static Job *job_list = NULL;
 static struct termios original_termios = {0};
+static uint8_t job_type = GC_TYPE_RAW;
+static uint8_t job_table_type = GC_TYPE_RAW;
+
+typedef struct JobTable {
+  int capacity;
+  Job *jobs[];
+} JobTable;
+
+static JobTable *job_table = NULL;
+static int max_job_id = 0;
+static int first_free_id = 1;
+static int current_job_id = 0;
+static int sigchld_fd = -1;
+
+static struct PendingJobs {
+  int *ids;
+  size_t count;
+  size_t capacity;
+} pending_jobs = {NULL, 0, 0};
+
+static struct PidMap {
+  struct PidEntry {
+    pid_t pid;
+    int job_id;
+  } *slots;
+  size_t capacity;
+  size_t count;
+} pid_map = {NULL, 0, 0};
+
+static void trace_job(void *memory) {
+  Job *job = memory;
+  gc_trace(job->command);
+}
+
+static void trace_job_table(void *memory) {
+  JobTable *table = memory;
+  for (int i = 0; i < table->capacity; i++)
+    gc_trace(table->jobs[i]);
+}
+
+void init_job_heap(void) {
+  job_type = gc_register_type(trace_job);
+  job_table_type = gc_register_type(trace_job_table);
+  gc_add_root((void **)&job_table);
+}
 
 void enable_raw_mode(void) {
   static struct termios raw = {0};
@@ -38,108 +107,436 @@ void disable_raw_mode(void) {
   tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_termios);
 }
 
-Command *new_command(void) {
-  Command *cmd = gc_alloc(sizeof(Command));
-  cmd->argc = 0;
-  for (size_t i = 0; i < ARGV_MAX; i++)
-    cmd->argv[i] = NULL;
-  cmd->next = NULL;
-  return cmd;
+static size_t pid_slot(pid_t pid, size_t capacity) {
+  return ((uint32_t)pid * 2654435761u) & (capacity - 1);
 }
 
-Command *add_command(Command *head, Command *new_cmd) {
-  Command *tmp = head;
-  while (tmp->next)
-    tmp = tmp->next;
-  tmp->next = new_cmd;
-  return tmp->next;
-}
+static void pid_map_grow(void) {
+  size_t capacity = pid_map.capacity ? pid_map.capacity * 2 : 64;
+  struct PidEntry *slots = calloc(capacity, sizeof(struct PidEntry));
+
+  if (slots == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
 
-void add_argv(Command *cmd, const char *arg) {
-  cmd->argv[cmd->argc++] = gc_strndup(arg, strlen(arg));
+  for (size_t i = 0; i < pid_map.capacity; i++) {
+    if (pid_map.slots[i].pid == 0)
+      continue;
+    size_t slot = pid_slot(pid_map.slots[i].pid, capacity);
+    while (slots[slot].pid != 0)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = pid_map.slots[i];
+  }
+
+  free(pid_map.slots);
+  pid_map.slots = slots;
+  pid_map.capacity = capacity;
 }
 
-Job *find_job_by_id(int job_id) {
-  Job **current = &job_list;
-  while (*current) {
-    if ((*current)->job_id == job_id)
-      return *current;
-    current = &(*current)->next;
+static struct PidEntry *pid_map_find(pid_t pid) {
+  if (pid_map.capacity == 0)
+    return NULL;
+
+  size_t slot = pid_slot(pid, pid_map.capacity);
+  while (pid_map.slots[slot].pid != 0) {
+    if (pid_map.slots[slot].pid == pid)
+      return &pid_map.slots[slot];
+    slot = (slot + 1) & (pid_map.capacity - 1);
   }
   return NULL;
 }
 
-int get_job_id(pid_t pgid) {
-  Job **current = &job_list;
-  while (*current) {
-    if ((*current)->pgid == pgid)
-      return (*current)->job_id;
-    current = &(*current)->next;
+static void pid_map_insert(pid_t pid, int job_id) {
+  if ((pid_map.count + 1) * 10 > pid_map.capacity * 7)
+    pid_map_grow();
+
+  size_t slot = pid_slot(pid, pid_map.capacity);
+  while (pid_map.slots[slot].pid != 0 && pid_map.slots[slot].pid != pid)
+    slot = (slot + 1) & (pid_map.capacity - 1);
+
+  if (pid_map.slots[slot].pid == 0)
+    pid_map.count++;
+  pid_map.slots[slot].pid = pid;
+  pid_map.slots[slot].job_id = job_id;
+}
+
+static void pid_map_remove(pid_t pid) {
+  struct PidEntry *entry = pid_map_find(pid);
+  if (entry == NULL)
+    return;
+
+  size_t mask = pid_map.capacity - 1;
+  size_t hole = entry - pid_map.slots;
+
+  for (size_t slot = (hole + 1) & mask; pid_map.slots[slot].pid != 0;
+       slot = (slot + 1) & mask) {
+    size_t home = pid_slot(pid_map.slots[slot].pid, pid_map.capacity);
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      pid_map.slots[hole] = pid_map.slots[slot];
+      hole = slot;
+    }
   }
-  return -1;
+
+  pid_map.slots[hole].pid = 0;
+  pid_map.count--;
+}
+
+static void job_table_reserve(int job_id) {
+  if (job_table && job_id < job_table->capacity)
+    return;
+
+  int capacity = job_table ? job_table->capacity * 2 : 16;
+  while (capacity <= job_id)
+    capacity *= 2;
+
+  JobTable *table = gc_alloc_typed(sizeof(JobTable) + capacity * sizeof(Job *),
+                                   job_table_type);
+  table->capacity = capacity;
+  for (int i = 0; i < capacity; i++)
+    table->jobs[i] = NULL;
+
+  if (job_table) {
+    for (int i = 0; i < job_table->capacity; i++) {
+      table->jobs[i] = job_table->jobs[i];
+      gc_write_barrier(table, table->jobs[i]);
+    }
+  }
+
+  job_table = table;
+}
+
+Job *find_job_by_id(int job_id) {
+  if (job_table == NULL || job_id <= 0 || job_id >= job_table->capacity)
+    return NULL;
+  return job_table->jobs[job_id];
+}
+
+Job *find_job_by_pid(pid_t pid) {
+  struct PidEntry *entry = pid_map_find(pid);
+  return entry ? find_job_by_id(entry->job_id) : NULL;
+}
+
+Job *find_current_job(void) { return find_job_by_id(current_job_id); }
+
+int get_job_id(pid_t pgid) {
+  Job *job = find_job_by_pid(pgid);
+  return job ? job->job_id : -1;
 }
 
 Job *add_job(pid_t pgid, const char *command, int status) {
-  Job *job = gc_alloc(sizeof(Job));
-  job->job_id = rand();
+  int job_id = first_free_id;
+  while (find_job_by_id(job_id) != NULL)
+    job_id++;
+  first_free_id = job_id + 1;
+
+  Job *job = gc_alloc_typed(sizeof(Job), job_type);
+  job->job_id = job_id;
   job->pgid = pgid;
-  job->command = gc_strndup(command, strlen(command));
+  job->command =
+      (char *)gc_strndup((const uint8_t *)command, strlen(command));
+  gc_write_barrier(job, job->command);
   job->status = status;
-  job->next = job_list;
-  job_list = job;
+  job->exit_code = 0;
+  job->pending = false;
+  job->nprocs = 0;
+  job->nalive = 0;
+
+  job_table_reserve(job_id);
+  job_table->jobs[job_id] = job;
+  gc_write_barrier(job_table, job);
+
+  if (job_id > max_job_id)
+    max_job_id = job_id;
+  current_job_id = job_id;
   return job;
 }
 
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return syscall(SYS_pidfd_open, pid, 0);
+#else
+  return -1;
+#endif
+}
+
+void add_job_process(Job *job, pid_t pid) {
+  assert(job->nprocs < PIPELINE_MAX);
+
+  Process *proc = &job->procs[job->nprocs++];
+  proc->pid = pid;
+  proc->pidfd = open_pidfd(pid);
+  proc->status = 0;
+  proc->done = false;
+  job->nalive++;
+  pid_map_insert(pid, job->job_id);
+}
+
+static Process *find_process(Job *job, pid_t pid) {
+  for (int i = 0; i < job->nprocs; i++)
+    if (job->procs[i].pid == pid)
+      return &job->procs[i];
+  return NULL;
+}
+
+static int job_exit_code(Job *job) {
+  int code = 0;
+
+  if (job->nprocs == 0)
+    return 0;
+
+  if (!shell_options.pipefail)
+    return job->procs[job->nprocs - 1].status;
+
+  for (int i = 0; i < job->nprocs; i++)
+    if (job->procs[i].status != 0)
+      code = job->procs[i].status;
+  return code;
+}
+
+static void process_exited(Job *job, Process *proc, int status) {
+  if (proc->done)
+    return;
+
+  proc->done = true;
+  proc->status = status;
+  if (proc->pidfd != -1) {
+    close(proc->pidfd);
+    proc->pidfd = -1;
+  }
+  pid_map_remove(proc->pid);
+
+  if (--job->nalive == 0) {
+    job->status = JSTAT_Done;
+    job->exit_code = job_exit_code(job);
+  }
+}
+
 void update_job_status(pid_t pgid, int status) {
-  Job **current = &job_list;
-  while (*current) {
-    if ((*current)->pgid == pgid) {
-      (*current)->status = status;
-      return;
-    }
-    current = &(*current)->next;
+  Job *job = find_job_by_pid(pgid);
+  if (job)
+    job->status = status;
+}
+
+static void delete_job(Job *job) {
+  int job_id = job->job_id;
+
+  for (int i = 0; i < job->nprocs; i++) {
+    pid_map_remove(job->procs[i].pid);
+    if (job->procs[i].pidfd != -1)
+      close(job->procs[i].pidfd);
   }
+
+  job_table->jobs[job_id] = NULL;
+  if (job_id < first_free_id)
+    first_free_id = job_id;
+
+  while (max_job_id > 0 && job_table->jobs[max_job_id] == NULL)
+    max_job_id--;
+  if (current_job_id == job_id)
+    current_job_id = max_job_id;
 }
 
 void remove_job(pid_t pgid) {
-  Job **current = &job_list;
-  while (*current) {
-    if ((*current)->pgid == pgid) {
-      *current = (*current)->next;
-      return;
-    }
-    current = &(*current)->next;
-  }
+  Job *job = find_job_by_pid(pgid);
+  if (job)
+    delete_job(job);
 }
 
 void kill_job(int job_id, int signal) {
   Job *job = find_job_by_id(job_id);
+  if (job == NULL)
+    return;
   kill(-job->pgid, signal);
-  remove_job(job->pgid);
+  delete_job(job);
 }
 
 void kill_job_by_status(int status) {
-  Job **current = &job_list;
-  while (*current) {
-    if ((*current)->status == status)
-      kill_job((*current)->job_id, SIGINT);
-    current = &(*current)->next;
+  for (int job_id = 1; job_id <= max_job_id; job_id++) {
+    Job *job = find_job_by_id(job_id);
+    if (job && job->status == status)
+      kill_job(job_id, SIGINT);
+  }
+}
+
+static void mark_pending(Job *job) {
+  if (job->pending)
+    return;
+
+  if (pending_jobs.count == pending_jobs.capacity) {
+    pending_jobs.capacity = pending_jobs.capacity ? pending_jobs.capacity * 2 : 16;
+    pending_jobs.ids =
+        realloc(pending_jobs.ids, pending_jobs.capacity * sizeof(int));
+
+    if (pending_jobs.ids == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  job->pending = true;
+  pending_jobs.ids[pending_jobs.count++] = job->job_id;
+}
+
+void init_job_signals(void) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+
+  sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sigchld_fd == -1) {
+    perror("signalfd");
+    exit(EXIT_FAILURE);
   }
 }
 
-void handle_sigchld(int _) {
+void reap_children(void) {
   int status;
   pid_t pid;
   while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+    Job *job = find_job_by_pid(pid);
+    Process *proc = job ? find_process(job, pid) : NULL;
+    if (proc == NULL)
+      continue;
+
     if (WIFEXITED(status) || WIFSIGNALED(status)) {
-      update_job_status(pid, JSTAT_Done);
-      remove_job(pid);
+      process_exited(job, proc, wait_status(status));
+      if (job->status == JSTAT_Done)
+        mark_pending(job);
     } else if (WIFSTOPPED(status)) {
-      update_job_status(pid, JSTAT_Stopped);
+      job->status = JSTAT_Stopped;
+      mark_pending(job);
     } else if (WIFCONTINUED(status)) {
-      update_job_status(pid, JSTAT_Running);
+      job->status = JSTAT_Running;
+    }
+  }
+}
+
+void notify_jobs(void) {
+  for (size_t i = 0; i < pending_jobs.count; i++) {
+    Job *job = find_job_by_id(pending_jobs.ids[i]);
+    if (job == NULL || !job->pending)
+      continue;
+
+    job->pending = false;
+    if (job->status == JSTAT_Done) {
+      if (job->exit_code == 0)
+        fprintf(stderr, "[%d]  Done\t%s\n", job->job_id, job->command);
+      else
+        fprintf(stderr, "[%d]  Exit %d\t%s\n", job->job_id, job->exit_code,
+                job->command);
+      delete_job(job);
+    } else if (job->status == JSTAT_Stopped) {
+      fprintf(stderr, "[%d]  Stopped\t%s\n", job->job_id, job->command);
+    }
+  }
+
+  pending_jobs.count = 0;
+}
+
+void wait_for_input(void) {
+  struct pollfd fds[2] = {
+      {STDIN_FILENO, POLLIN, 0},
+      {sigchld_fd, POLLIN, 0},
+  };
+
+  for (;;) {
+    if (poll(fds, sigchld_fd == -1 ? 1 : 2, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      return;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      struct signalfd_siginfo info[16];
+      while (read(sigchld_fd, info, sizeof(info)) > 0)
+        ;
+      reap_children();
+    }
+
+    if (fds[0].revents)
+      return;
+  }
+}
+
+static int siginfo_status(siginfo_t *info) {
+  if (info->si_code == CLD_EXITED)
+    return info->si_status;
+  return 128 + info->si_status;
+}
+
+static void collect_process(Job *job, Process *proc) {
+  siginfo_t info;
+  info.si_pid = 0;
+
+  if (proc->pidfd >= 0 &&
+      waitid(P_PIDFD, proc->pidfd, &info, WEXITED | WNOHANG) == 0) {
+    if (info.si_pid != 0)
+      process_exited(job, proc, siginfo_status(&info));
+    return;
+  }
+
+  /* Kernels before 5.4 hand out pidfds but reject P_PIDFD in waitid. */
+  int status;
+  if (waitpid(proc->pid, &status, WNOHANG) == proc->pid)
+    process_exited(job, proc, wait_status(status));
+}
+
+static int wait_job(Job *job) {
+  struct pollfd fds[PIPELINE_MAX + 1];
+  Process *polled[PIPELINE_MAX];
+
+  while (job->nalive > 0 && job->status != JSTAT_Stopped) {
+    if (sigchld_fd == -1) {
+      int status;
+      pid_t pid = waitpid(-job->pgid, &status, WUNTRACED);
+      Process *proc = pid > 0 ? find_process(job, pid) : NULL;
+
+      if (pid == -1)
+        break;
+      if (proc == NULL)
+        continue;
+      if (WIFSTOPPED(status))
+        job->status = JSTAT_Stopped;
+      else
+        process_exited(job, proc, wait_status(status));
+      continue;
+    }
+
+    int nfds = 0;
+    for (int i = 0; i < job->nprocs; i++) {
+      Process *proc = &job->procs[i];
+      if (proc->done || proc->pidfd == -1)
+        continue;
+      polled[nfds] = proc;
+      fds[nfds++] = (struct pollfd){proc->pidfd, POLLIN, 0};
+    }
+    fds[nfds] = (struct pollfd){sigchld_fd, POLLIN, 0};
+
+    if (poll(fds, nfds + 1, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+
+    for (int i = 0; i < nfds; i++)
+      if (fds[i].revents)
+        collect_process(job, polled[i]);
+
+    if (fds[nfds].revents & POLLIN) {
+      struct signalfd_siginfo info[16];
+      while (read(sigchld_fd, info, sizeof(info)) > 0)
+        ;
+      reap_children();
     }
   }
+
+  if (job->status == JSTAT_Stopped)
+    return 128 + SIGTSTP;
+  return job->exit_code;
 }
 
 void handle_sigstop(int _) {
@@ -161,155 +558,627 @@ void handle_terminal_signals(void) {
   sigaction(SIGINT, &sa, NULL);
 }
 
-void launch_job(Command *cmds, bool background) {
+int shell_pipe(int fds[2], int flags) {
+  if (pipe2(fds, flags) == -1)
+    return -1;
+
+  if (shell_options.pipesize > 0 &&
+      fcntl(fds[0], F_SETPIPE_SZ, shell_options.pipesize) == -1) {
+    static bool warned = false;
+    if (!warned)
+      fprintf(stderr, "squash: pipesize %d: %s\n", shell_options.pipesize,
+              strerror(errno));
+    warned = true;
+  }
+  return 0;
+}
+
+static int memfd_state = -1;
+
+static int open_here_memfd(const char *text, size_t length, bool newline) {
+  int fd = memfd_create("squash-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1) {
+    if (errno == ENOSYS || errno == EINVAL)
+      memfd_state = 0;
+    return -1;
+  }
+
+  struct iovec iov[2] = {{(void *)text, length}, {"\n", newline ? 1 : 0}};
+  int iovcnt = 2;
+  struct iovec *cursor = iov;
+
+  while (iovcnt > 0) {
+    ssize_t written = writev(fd, cursor, iovcnt);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      return -1;
+    }
+    while (iovcnt > 0 && (size_t)written >= cursor->iov_len) {
+      written -= cursor->iov_len;
+      cursor++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      cursor->iov_base = (char *)cursor->iov_base + written;
+      cursor->iov_len -= written;
+    }
+  }
+
+  fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+  lseek(fd, 0, SEEK_SET);
+  memfd_state = 1;
+  return fd;
+}
+
+static void splice_here_document(int fd, const char *text, size_t length,
+                                 bool newline) {
+  struct iovec iov[2] = {{(void *)text, length}, {"\n", newline ? 1 : 0}};
+
+  for (int i = 0; i < 2; i++) {
+    while (iov[i].iov_len > 0) {
+      ssize_t written = vmsplice(fd, &iov[i], 1, 0);
+      if (written == -1 && errno == EINTR)
+        continue;
+      if (written == -1)
+        written = write(fd, iov[i].iov_base, iov[i].iov_len);
+      if (written <= 0)
+        return;
+      iov[i].iov_base = (char *)iov[i].iov_base + written;
+      iov[i].iov_len -= written;
+    }
+  }
+}
+
+static int pipe_here_document(const char *text, size_t length, bool newline) {
+  int fds[2];
+  if (shell_pipe(fds, O_CLOEXEC) == -1)
+    return -1;
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    splice_here_document(fds[1], text, length, newline);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  if (pid == -1) {
+    close(fds[0]);
+    return -1;
+  }
+  return fds[0];
+}
+
+static int open_here_document(const char *text, size_t length,
+                              bool newline) {
+  if (memfd_state != 0) {
+    int fd = open_here_memfd(text, length, newline);
+    if (fd != -1)
+      return fd;
+  }
+  return pipe_here_document(text, length, newline);
+}
+
+static int default_redirect_fd(int kind) {
+  switch (kind) {
+  case REDIR_In:
+  case REDIR_DupIn:
+  case REDIR_HereStr:
+  case REDIR_HereDoc:
+  case REDIR_RW:
+    return STDIN_FILENO;
+  default:
+    return STDOUT_FILENO;
+  }
+}
+
+static int redirect_fd(Redirect *redir) {
+  return redir->fno >= 0 ? redir->fno : default_redirect_fd(redir->kind);
+}
+
+void save_redirects(Command *cmd, int *saved) {
+  for (int i = 0; i < cmd->nredirs; i++)
+    saved[i] = fcntl(redirect_fd(&cmd->redirs[i]), F_DUPFD_CLOEXEC, 10);
+}
+
+void restore_redirects(Command *cmd, int *saved) {
+  for (int i = cmd->nredirs - 1; i >= 0; i--) {
+    int target_fd = redirect_fd(&cmd->redirs[i]);
+    if (saved[i] == -1) {
+      close(target_fd);
+      continue;
+    }
+    dup2(saved[i], target_fd);
+    close(saved[i]);
+  }
+}
+
+int apply_redirects(Command *cmd) {
+  for (int i = 0; i < cmd->nredirs; i++) {
+    Redirect *redir = &cmd->redirs[i];
+    int target_fd = redirect_fd(redir);
+    int fd = -1;
+
+    switch (redir->kind) {
+    case REDIR_In:
+      fd = open(redir->target, O_RDONLY);
+      break;
+    case REDIR_Out:
+    case REDIR_NoClobber:
+      fd = open(redir->target, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      break;
+    case REDIR_Append:
+      fd = open(redir->target, O_WRONLY | O_CREAT | O_APPEND, 0666);
+      break;
+    case REDIR_RW:
+      fd = open(redir->target, O_RDWR | O_CREAT, 0666);
+      break;
+    case REDIR_DupIn:
+    case REDIR_DupOut:
+      if (!strcmp(redir->target, "-")) {
+        close(target_fd);
+        continue;
+      }
+      fd = dup(atoi(redir->target));
+      break;
+    case REDIR_HereStr:
+      fd = open_here_document(redir->target, redir->length, true);
+      break;
+    case REDIR_HereDoc:
+      fd = open_here_document(redir->target, redir->length, false);
+      break;
+    }
+
+    if (fd == -1) {
+      perror(redir->target);
+      return -1;
+    }
+
+    if (fd != target_fd) {
+      dup2(fd, target_fd);
+      close(fd);
+    }
+  }
+
+  return 0;
+}
+
+int wait_status(int status) {
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  if (WIFSTOPPED(status))
+    return 128 + WSTOPSIG(status);
+  return 0;
+}
+
+static int add_redirect_actions(posix_spawn_file_actions_t *actions,
+                                Command *cmd, int *here_fds, int *nhere) {
+  for (int i = 0; i < cmd->nredirs; i++) {
+    Redirect *redir = &cmd->redirs[i];
+    int target_fd = redirect_fd(redir);
+    int err = 0;
+
+    switch (redir->kind) {
+    case REDIR_In:
+      err = posix_spawn_file_actions_addopen(actions, target_fd, redir->target,
+                                             O_RDONLY, 0);
+      break;
+    case REDIR_Out:
+    case REDIR_NoClobber:
+      err = posix_spawn_file_actions_addopen(actions, target_fd, redir->target,
+                                             O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      break;
+    case REDIR_Append:
+      err = posix_spawn_file_actions_addopen(actions, target_fd, redir->target,
+                                             O_WRONLY | O_CREAT | O_APPEND, 0666);
+      break;
+    case REDIR_RW:
+      err = posix_spawn_file_actions_addopen(actions, target_fd, redir->target,
+                                             O_RDWR | O_CREAT, 0666);
+      break;
+    case REDIR_DupIn:
+    case REDIR_DupOut:
+      if (!strcmp(redir->target, "-"))
+        err = posix_spawn_file_actions_addclose(actions, target_fd);
+      else
+        err = posix_spawn_file_actions_adddup2(actions, atoi(redir->target),
+                                               target_fd);
+      break;
+    case REDIR_HereStr:
+    case REDIR_HereDoc: {
+      int fd = open_here_document(redir->target, redir->length,
+                                  redir->kind == REDIR_HereStr);
+      if (fd == -1)
+        return errno;
+      here_fds[(*nhere)++] = fd;
+      err = posix_spawn_file_actions_adddup2(actions, fd, target_fd);
+      break;
+    }
+    }
+
+    if (err)
+      return err;
+  }
+
+  return 0;
+}
+
+static char **command_environ(Command *cmd) {
+  return cmd->envp ? cmd->envp : vars_environ();
+}
+
+static bool parent_writable(const char *target) {
+  char dir[PATH_MAX];
+  const char *slash = strrchr(target, '/');
+
+  if (slash == NULL)
+    return access(".", W_OK | X_OK) == 0;
+
+  size_t length = slash == target ? 1 : (size_t)(slash - target);
+  if (length >= sizeof(dir))
+    return false;
+
+  memcpy(dir, target, length);
+  dir[length] = '\0';
+  return access(dir, W_OK | X_OK) == 0;
+}
+
+static const char *failed_redirect(Command *cmd) {
+  for (int i = 0; i < cmd->nredirs; i++) {
+    Redirect *redir = &cmd->redirs[i];
+
+    switch (redir->kind) {
+    case REDIR_In:
+      if (access(redir->target, R_OK) == -1)
+        return redir->target;
+      break;
+    case REDIR_Out:
+    case REDIR_NoClobber:
+    case REDIR_Append:
+    case REDIR_RW:
+      if (access(redir->target, W_OK) == 0)
+        break;
+      if (errno != ENOENT || !parent_writable(redir->target))
+        return redir->target;
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+static pid_t spawn_command(Command *cmd, pid_t pgid, int in_fd, int out_fd,
+                           int close_fd) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t defaults, mask;
+  pid_t pid = -1;
+  int here_fds[REDIR_MAX];
+  int nhere = 0;
+  int err;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+  if (in_fd != -1) {
+    posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, in_fd);
+  }
+  if (out_fd != -1) {
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, out_fd);
+  }
+  if (close_fd != -1)
+    posix_spawn_file_actions_addclose(&actions, close_fd);
+
+  err = add_redirect_actions(&actions, cmd, here_fds, &nhere);
+
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGINT);
+  sigaddset(&defaults, SIGQUIT);
+  sigaddset(&defaults, SIGTSTP);
+  sigaddset(&defaults, SIGTTIN);
+  sigaddset(&defaults, SIGTTOU);
+  sigaddset(&defaults, SIGCHLD);
+  sigemptyset(&mask);
+
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setsigmask(&attr, &mask);
+  posix_spawnattr_setpgroup(&attr, pgid);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF |
+                                      POSIX_SPAWN_SETSIGMASK);
+
+  const char *path = cmdhash_lookup(cmd->argv[0]);
+
+  if (err == 0 && path != NULL) {
+    err = posix_spawn(&pid, path, &actions, &attr, (char *const *)cmd->argv,
+                      command_environ(cmd));
+
+    /* ENOENT also comes from a redirect's open in the child; only a hashed
+     * path that has really gone away is worth a fresh PATH search. */
+    if (err == ENOENT && access(path, X_OK) == -1 &&
+        cmdhash_forget(cmd->argv[0]) &&
+        (path = cmdhash_lookup(cmd->argv[0])) != NULL)
+      err = posix_spawn(&pid, path, &actions, &attr,
+                        (char *const *)cmd->argv, command_environ(cmd));
+  }
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  for (int i = 0; i < nhere; i++)
+    close(here_fds[i]);
+
+  if (path == NULL) {
+    fprintf(stderr, "squash: %s: command not found\n", cmd->argv[0]);
+    return -1;
+  }
+
+  if (err == ENOSYS)
+    return SPAWN_UNSUPPORTED;
+
+  if (err) {
+    const char *target = failed_redirect(cmd);
+    fprintf(stderr, "squash: %s: %s\n", target ? target : cmd->argv[0],
+            strerror(err));
+    return -1;
+  }
+
+  return pid;
+}
+
+static pid_t fork_command(Command *cmd, pid_t pgid, int in_fd, int out_fd,
+                          int close_fd, bool background) {
+  const char *path = cmdhash_lookup(cmd->argv[0]);
+
+  if (path == NULL) {
+    fprintf(stderr, "squash: %s: command not found\n", cmd->argv[0]);
+    return -1;
+  }
+
+  char **envp = command_environ(cmd);
+  pid_t pid = fork();
+  if (pid == 0) {
+    setpgid(0, pgid);
+    if (!background && interactive) {
+      tcsetpgrp(STDIN_FILENO, pgid ? pgid : getpid());
+    }
+
+    if (in_fd != -1) {
+      dup2(in_fd, STDIN_FILENO);
+      close(in_fd);
+    }
+
+    if (out_fd != -1) {
+      dup2(out_fd, STDOUT_FILENO);
+      close(out_fd);
+    }
+
+    if (close_fd != -1)
+      close(close_fd);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+
+    if (apply_redirects(cmd) == -1)
+      exit(EXIT_FAILURE);
+
+    execve(path, (char *const *)cmd->argv, envp);
+    perror(cmd->argv[0]);
+    exit(127);
+  } else if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+
+  return pid;
+}
+
+int launch_job(Command *cmds, bool background) {
   int pipe_fds[2];
   int prev_fd = -1;
   pid_t pgid = 0;
+  pid_t last_pid = 0;
+  int last_status = 0;
+  bool last_failed = false;
   Job *job = NULL;
-  Command **current_cmd = &cmds;
+  int ncmds = 0;
 
-  while (*current_cmd) {
-    if ((*current_cmd)->next != NULL) {
-      if (pipe(pipe_fds) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-      }
-    }
+  for (Command *cmd = cmds; cmd; cmd = cmd->next)
+    ncmds++;
 
-    pid_t pid = fork();
-    if (pid == 0) {
-      setpgid(0, 0);
-      if (!background) {
-        tcsetpgrp(STDIN_FILENO, getpid());
-      }
+  if (ncmds > PIPELINE_MAX) {
+    fprintf(stderr, "squash: pipeline longer than %d commands\n",
+            PIPELINE_MAX);
+    return 1;
+  }
 
-      if (prev_fd != -1) {
-        dup2(prev_fd, STDIN_FILENO);
-        close(prev_fd);
-      }
+  for (Command *cmd = cmds; cmd; cmd = cmd->next) {
+    int out_fd = -1;
+    int next_fd = -1;
 
-      if ((*current_cmd)->next != NULL) {
-        dup2(pipe_fds[1], STDOUT_FILENO);
-        close(pipe_fds[1]);
-        close(pipe_fds[0]);
+    if (cmd->next != NULL) {
+      if (shell_pipe(pipe_fds, 0) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
       }
+      out_fd = pipe_fds[1];
+      next_fd = pipe_fds[0];
+    }
 
-      signal(SIGINT, handle_sigint);
-      signal(SIGSTOP, handle_sigstop);
-      signal(SIGCHLD, handle_sigchld);
+    pid_t pid = spawn_command(cmd, pgid, prev_fd, out_fd, next_fd);
+    if (pid == SPAWN_UNSUPPORTED)
+      pid = fork_command(cmd, pgid, prev_fd, out_fd, next_fd, background);
 
-      execvp((*current_cmd)->argv[0], (char *const *)&(*current_cmd)->argv[0]);
-      perror("execvp");
-      exit(EXIT_FAILURE);
-    } else if (pid > 0) {
+    if (pid > 0) {
       if (pgid == 0)
         pgid = pid;
       setpgid(pid, pgid);
 
       if (!job) {
-        job = add_job(pgid, (*current_cmd)->argv[0], background);
+        job = add_job(pgid, cmd->argv[0], JSTAT_Running);
       }
-
-      if (prev_fd != -1)
-        close(prev_fd);
-
-      if ((*current_cmd)->next != NULL) {
-        close(pipe_fds[1]);
-        prev_fd = pipe_fds[0];
-      }
-    } else {
-      perror("fork");
-      exit(EXIT_FAILURE);
+      add_job_process(job, pid);
+      last_pid = pid;
+    } else if (cmd->next == NULL) {
+      last_status = 127;
+      last_failed = true;
     }
 
-    current_cmd = &(*current_cmd)->next;
+    if (prev_fd != -1)
+      close(prev_fd);
+    if (out_fd != -1)
+      close(out_fd);
+    prev_fd = next_fd;
   }
 
+  if (pgid == 0)
+    return last_status;
+
   if (!background) {
-    tcsetpgrp(STDIN_FILENO, pgid);
-    int status;
-    waitpid(-pgid, &status, WUNTRACED);
+    if (interactive)
+      tcsetpgrp(STDIN_FILENO, pgid);
+    int status = wait_job(job);
 
-    if (WIFSTOPPED(status)) {
-      update_job_status(pgid, JSTAT_Stopped);
-    } else {
-      remove_job(pgid);
-    }
+    if (job->status != JSTAT_Stopped)
+      delete_job(job);
 
-    tcsetpgrp(STDIN_FILENO, getpid());
+    if (!last_failed)
+      last_status = status;
+
+    if (interactive)
+      tcsetpgrp(STDIN_FILENO, getpid());
   } else {
+    last_background = last_pid;
     fprintf(stderr, "[%d] %d\n", job->job_id, pgid);
   }
 
+  return last_status;
 }
 
-void execute_fg(int job_id) {
+int execute_fg(int job_id) {
   Job *job = find_job_by_id(job_id);
-  if (job) {
-    tcsetpgrp(STDIN_FILENO, job->pgid);
-    kill(-job->pgid, SIGCONT);
-    waitpid(-job->pgid, NULL, WUNTRACED);
+  if (job == NULL)
+    return -1;
+
+  pid_t pgid = job->pgid;
+  if (interactive)
+    tcsetpgrp(STDIN_FILENO, pgid);
+  kill(-pgid, SIGCONT);
+  job->status = JSTAT_Running;
+
+  int status = wait_job(job);
+  if (job->status != JSTAT_Stopped)
+    delete_job(job);
+
+  if (interactive)
     tcsetpgrp(STDIN_FILENO, getpid());
-  }
+  return status;
 }
 
-void execute_bg(int job_id) {
+int execute_bg(int job_id) {
   Job *job = find_job_by_id(job_id);
-  if (job) {
-    kill(-job->pgid, SIGCONT);
-    job->status = JSTAT_Running;
-  }
+  if (job == NULL)
+    return -1;
+
+  kill(-job->pgid, SIGCONT);
+  job->status = JSTAT_Running;
+  return 0;
+}
+
+static bool has_control_char(const char *line, size_t length) {
+  for (size_t i = 0; i < length; i++)
+    if (line[i] == '\x04' || line[i] == '\x03' || line[i] == '\x1a' ||
+        line[i] == '\x00')
+      return true;
+  return false;
 }
 
 int main(int argc, char **argv) {
   gc_init();
-  atexit(gc_shutdown);
-  handle_terminal_signals();
-  enable_raw_mode();
+  init_job_heap();
+  init_job_signals();
+  set_positional_params(1, argv);
+
+  if (argc > 1) {
+    int status;
+
+    if (!strcmp(argv[1], "-c")) {
+      if (argc < 3) {
+        fprintf(stderr, "squash: -c: option requires an argument\n");
+        return 2;
+      }
+      if (argc > 3)
+        set_positional_params(argc - 3, &argv[3]);
+      status = run_command_string(argv[2]);
+    } else {
+      set_positional_params(argc - 1, &argv[1]);
+      status = run_script(argv[1]);
+    }
+
+    return do_exit ? exit_status : status;
+  }
+
+  interactive = isatty(STDIN_FILENO);
+  if (interactive) {
+    handle_terminal_signals();
+    enable_raw_mode();
+  }
+
+  InputReader *reader = new_input_reader(STDIN_FILENO);
 
   for (;;) {
-    printf("squash> ");
-    fflush(stdout);
-
-    int inchr = 0;
-    char *prompt = gc_alloc(LINE_SIZE);
-    size_t cursor = 0;
-
-    while (read(STDIN_FILENO, &inchr, 1)
-		&& inchr != '\x04'
-		&& inchr != '\x03'
-		&& inchr != '\x1a'
-		&& inchr != '\x00'
-		&& inchr != '\r' 
-		&& inchr != '\n') {
-      if (inchr == '\x04'
-	  || inchr == '\x03'
-	  || inchr == '\x1a'
-	  || inchr == '\x00')
-	goto exit_check;
-      prompt[cursor++] = inchr;
-      if (cursor >= LINE_SIZE)
-	break;
+    gc_safepoint();
+    reap_children();
+    notify_jobs();
+
+    if (interactive) {
+      printf("squash> ");
+      fflush(stdout);
+      if (!input_buffered(reader))
+        wait_for_input();
     }
 
-    printf("\n");
+    char *line;
+    ssize_t length = input_read_line(reader, &line);
+
+    if (length < 0)
+      break;
+    if (length > 0 && line[length - 1] == '\r')
+      length--;
+    if (interactive) {
+      if (has_control_char(line, length))
+        break;
+      printf("\n");
+    }
 
-    prompt[cursor] = ';';
-    YY_BUFFER_STATE buffer = yy_scan_string(prompt);
+    line[length] = ';';
+    line[length + 1] = '\0';
+    YY_BUFFER_STATE buffer = yy_scan_string(line);
 
     while (yyparse())
       ;
 
     yy_delete_buffer(buffer);
+    ast_arena_reset();
 
-exit_check:
-    if (inchr == '\x04' 
-	|| inchr == '\x03' 
-	|| inchr == '\x1a'
-	|| inchr == '\x00'
-	|| do_exit == true)
-	break;
+    if (do_exit)
+      break;
   }
 
-  disable_raw_mode();
+  delete_input_reader(reader);
+  if (interactive)
+    disable_raw_mode();
+  return exit_status;
 }
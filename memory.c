@@ -1,59 +1,463 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "common.h"
 #include "memory.h"
 
-#define ALIGNMENT 256
-#define DEFAULT_HEAP_SIZE 8096
+#define DEFAULT_HEAP_SIZE (1024 * 1024)
+#define GC_MAGIC 0x4743u
+#define GC_MIN_CLASS_SHIFT 4
+#define GC_NUM_CLASSES 8
+#define GC_MAX_CLASS_SIZE (1 << (GC_MIN_CLASS_SHIFT + GC_NUM_CLASSES - 1))
+#define GC_MAX_TYPES 256
+#define GC_STEP_WORK 1024
+#define GC_BYTES_PER_WORK 64
+#define GC_NURSERY_SIZE (256 * 1024)
+#define GC_LARGE 0xff
+#define GC_LIVE 0x01
+#define GC_EPOCH 0x02
+#define GC_OLD 0x04
+#define GC_YOUNG_MARK 0x08
+#define GC_REMEMBERED 0x10
+#define ARENA_ALIGNMENT sizeof(void *)
 
 struct GCObject {
-  void *memory;
-  bool marked;
+  uint32_t size;
+  uint32_t refs;
+  uint16_t magic;
+  uint8_t sclass;
+  uint8_t flags;
+  uint8_t type;
+  _Alignas(max_align_t) uint8_t memory[];
+};
+
+typedef struct GCSlab {
+  struct GCSlab *next;
+  size_t slot_size;
+  size_t nslots;
+  size_t used;
+  _Alignas(max_align_t) uint8_t slots[];
+} GCSlab;
+
+typedef struct GCLarge {
+  struct GCLarge *prev;
+  struct GCLarge *next;
+  _Alignas(max_align_t) GCObject object;
+} GCLarge;
+
+typedef struct GCCursor {
+  size_t sclass;
+  GCSlab *slab;
+  size_t index;
+  GCLarge *large;
+  bool in_large;
+  bool done;
+} GCCursor;
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
   size_t size;
-  size_t refs;
-  struct GCObject *next;
+  size_t used;
+  _Alignas(max_align_t) uint8_t memory[];
+} ArenaChunk;
+
+struct Arena {
+  ArenaChunk *chunks;
+  size_t chunk_size;
+  void *last;
 };
 
 static struct GCHeap {
-  GCObject *objects;
+  GCSlab *slabs[GC_NUM_CLASSES];
+  GCObject *free_lists[GC_NUM_CLASSES];
+  GCLarge *large;
   size_t num_objects;
+  size_t bytes_live;
+  size_t debt;
+  size_t threshold;
+  size_t young_bytes;
+
+  enum GCPhase {
+    GC_Idle,
+    GC_Mark,
+    GC_Sweep,
+  } phase;
+
+  uint8_t epoch;
+  bool minor;
+  GCCursor cursor;
+
+  void ***roots;
+  size_t nroots;
+  size_t roots_cap;
+
+  GCObject **grey;
+  size_t ngrey;
+  size_t grey_cap;
+
+  GCObject **young;
+  size_t nyoung;
+  size_t young_cap;
+
+  GCObject **remembered;
+  size_t nremembered;
+  size_t remembered_cap;
+
+  GCStats stats;
+  uint64_t total_pause_ns;
+  uint64_t max_pause_ns;
 } *heap = NULL;
 
-void gc_init(void) {
-  heap = malloc(sizeof(GCHeap));
-  heap->objects = NULL;
-  heap->num_objects = 0;
-}
+static GCTraceFn gc_types[GC_MAX_TYPES] = {NULL};
+static size_t gc_ntypes = 1;
 
-GCObject *new_gc_object(void) {
-  GCObject *obj = malloc(sizeof(GCObject));
-  obj->memory = NULL;
-  obj->marked = false;
-  obj->size = 0;
-  obj->refs = 0;
-  obj->next = heap->objects;
-  heap->objects = obj;
+static inline GCObject *gc_object_of(void *memory) {
+  GCObject *obj = (GCObject *)((uint8_t *)memory - offsetof(GCObject, memory));
+  assert(obj->magic == GC_MAGIC && (obj->flags & GC_LIVE));
   return obj;
 }
 
-void *gc_alloc(size_t size) {
-  GCObject *obj = new_gc_object();
-  size_t aligned_size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
-  obj->memory = calloc(1, aligned_size);
+static inline GCLarge *gc_large_of(GCObject *obj) {
+  return (GCLarge *)((uint8_t *)obj - offsetof(GCLarge, object));
+}
+
+static inline GCObject **gc_free_link(GCObject *obj) {
+  return (GCObject **)obj->memory;
+}
+
+static inline size_t gc_size_class(size_t size) {
+  if (size <= (1 << GC_MIN_CLASS_SHIFT))
+    return 0;
+  size_t shift = sizeof(unsigned long) * 8 - __builtin_clzl(size - 1);
+  return shift - GC_MIN_CLASS_SHIFT;
+}
+
+static inline size_t gc_class_size(size_t sclass) {
+  return (size_t)1 << (sclass + GC_MIN_CLASS_SHIFT);
+}
+
+static inline size_t gc_footprint(GCObject *obj) {
+  return obj->sclass == GC_LARGE ? obj->size : gc_class_size(obj->sclass);
+}
+
+static inline bool gc_is_marked(GCObject *obj) {
+  return ((obj->flags & GC_EPOCH) != 0) == heap->epoch;
+}
+
+static void *gc_grow_vector(void *vector, size_t *cap, size_t elem_size) {
+  *cap = *cap ? *cap * 2 : 64;
+  vector = realloc(vector, *cap * elem_size);
 
-  if (obj->memory == NULL) {
+  if (vector == NULL) {
     fprintf(stderr, "Allocation error\n");
     exit(EXIT_FAILURE);
   }
 
+  return vector;
+}
+
+static uint64_t gc_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void gc_record_pause(uint64_t start) {
+  uint64_t pause = gc_clock() - start;
+  heap->stats.pauses++;
+  heap->total_pause_ns += pause;
+  if (pause > heap->max_pause_ns)
+    heap->max_pause_ns = pause;
+}
+
+static void gc_shade(GCObject *obj) {
+  if (heap->minor) {
+    if (obj->flags & (GC_OLD | GC_YOUNG_MARK))
+      return;
+    obj->flags |= GC_YOUNG_MARK;
+  } else {
+    if (gc_is_marked(obj))
+      return;
+    obj->flags ^= GC_EPOCH;
+  }
+
+  if (gc_types[obj->type] == NULL)
+    return;
+
+  if (heap->ngrey == heap->grey_cap)
+    heap->grey =
+        gc_grow_vector(heap->grey, &heap->grey_cap, sizeof(GCObject *));
+  heap->grey[heap->ngrey++] = obj;
+}
+
+static GCSlab *new_gc_slab(size_t sclass) {
+  GCSlab *slab = mmap(NULL, DEFAULT_HEAP_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (slab == MAP_FAILED) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  slab->slot_size = sizeof(GCObject) + gc_class_size(sclass);
+  slab->nslots = (DEFAULT_HEAP_SIZE - sizeof(GCSlab)) / slab->slot_size;
+  slab->used = 0;
+  slab->next = heap->slabs[sclass];
+  heap->slabs[sclass] = slab;
+  return slab;
+}
+
+static GCObject *gc_slab_take(size_t sclass) {
+  GCObject *obj = heap->free_lists[sclass];
+  if (obj != NULL) {
+    heap->free_lists[sclass] = *gc_free_link(obj);
+    return obj;
+  }
+
+  GCSlab *slab = heap->slabs[sclass];
+  if (slab == NULL || slab->used == slab->nslots)
+    slab = new_gc_slab(sclass);
+  return (GCObject *)&slab->slots[slab->used++ * slab->slot_size];
+}
+
+static void gc_reclaim(GCObject *obj) {
+  obj->flags = 0;
+
+  if (obj->sclass == GC_LARGE) {
+    GCLarge *large = gc_large_of(obj);
+    if (heap->cursor.large == large)
+      heap->cursor.large = large->next;
+    if (large->prev != NULL)
+      large->prev->next = large->next;
+    else
+      heap->large = large->next;
+    if (large->next != NULL)
+      large->next->prev = large->prev;
+    free(large);
+    return;
+  }
+
+  *gc_free_link(obj) = heap->free_lists[obj->sclass];
+  heap->free_lists[obj->sclass] = obj;
+}
+
+static void gc_release(GCObject *obj) {
+  heap->num_objects--;
+  heap->bytes_live -= gc_footprint(obj);
+  heap->stats.bytes_freed += gc_footprint(obj);
+
+  if (obj->flags & GC_OLD)
+    gc_reclaim(obj);
+  else
+    obj->flags &= ~GC_LIVE;
+}
+
+static void gc_cursor_reset(void) {
+  heap->cursor.sclass = 0;
+  heap->cursor.slab = heap->slabs[0];
+  heap->cursor.index = 0;
+  heap->cursor.large = heap->large;
+  heap->cursor.in_large = false;
+  heap->cursor.done = false;
+}
+
+static GCObject *gc_cursor_next(void) {
+  GCCursor *cursor = &heap->cursor;
+
+  while (!cursor->in_large) {
+    if (cursor->slab != NULL && cursor->index < cursor->slab->used)
+      return (GCObject *)&cursor->slab
+          ->slots[cursor->index++ * cursor->slab->slot_size];
+
+    if (cursor->slab != NULL && cursor->slab->next != NULL) {
+      cursor->slab = cursor->slab->next;
+    } else if (++cursor->sclass < GC_NUM_CLASSES) {
+      cursor->slab = heap->slabs[cursor->sclass];
+    } else {
+      cursor->in_large = true;
+      cursor->large = heap->large;
+    }
+    cursor->index = 0;
+  }
+
+  GCLarge *large = cursor->large;
+  if (large == NULL) {
+    cursor->done = true;
+    return NULL;
+  }
+  cursor->large = large->next;
+  return &large->object;
+}
+
+static void gc_scan_roots(void) {
+  for (size_t i = 0; i < heap->nroots; i++)
+    gc_trace(*heap->roots[i]);
+}
+
+static void gc_promote_nursery(void) {
+  for (size_t i = 0; i < heap->nyoung; i++) {
+    GCObject *obj = heap->young[i];
+    if (obj->flags & GC_LIVE)
+      obj->flags |= GC_OLD;
+    else
+      gc_reclaim(obj);
+  }
+
+  for (size_t i = 0; i < heap->nremembered; i++)
+    heap->remembered[i]->flags &= ~GC_REMEMBERED;
+
+  heap->nyoung = 0;
+  heap->nremembered = 0;
+  heap->young_bytes = 0;
+}
+
+static void gc_minor(void) {
+  heap->minor = true;
+  heap->ngrey = 0;
+  gc_scan_roots();
+
+  for (size_t i = 0; i < heap->nremembered; i++) {
+    GCObject *obj = heap->remembered[i];
+    obj->flags &= ~GC_REMEMBERED;
+    if ((obj->flags & GC_LIVE) && gc_types[obj->type])
+      gc_types[obj->type](obj->memory);
+  }
+  heap->nremembered = 0;
+
+  for (size_t i = 0; i < heap->nyoung; i++) {
+    GCObject *obj = heap->young[i];
+    if ((obj->flags & GC_LIVE) && obj->refs > 0)
+      gc_shade(obj);
+  }
+
+  while (heap->ngrey > 0) {
+    GCObject *obj = heap->grey[--heap->ngrey];
+    gc_types[obj->type](obj->memory);
+  }
+  heap->minor = false;
+
+  for (size_t i = 0; i < heap->nyoung; i++) {
+    GCObject *obj = heap->young[i];
+    if (obj->flags & GC_YOUNG_MARK) {
+      obj->flags = (obj->flags & ~GC_YOUNG_MARK) | GC_OLD;
+      heap->debt += gc_footprint(obj);
+      continue;
+    }
+    if (obj->flags & GC_LIVE)
+      gc_release(obj);
+    gc_reclaim(obj);
+  }
+
+  heap->nyoung = 0;
+  heap->young_bytes = 0;
+  heap->stats.minor_collections++;
+}
+
+static void gc_start_cycle(void) {
+  gc_promote_nursery();
+  heap->epoch ^= 1;
+  heap->phase = GC_Mark;
+  heap->ngrey = 0;
+  gc_cursor_reset();
+  gc_scan_roots();
+}
+
+static void gc_finish_cycle(void) {
+  heap->phase = GC_Idle;
+  heap->stats.major_collections++;
+  heap->threshold = heap->bytes_live > DEFAULT_HEAP_SIZE ? heap->bytes_live
+                                                         : DEFAULT_HEAP_SIZE;
+  heap->debt = 0;
+}
+
+void gc_init(void) {
+  heap = calloc(1, sizeof(GCHeap));
+  heap->threshold = DEFAULT_HEAP_SIZE;
+}
+
+uint8_t gc_register_type(GCTraceFn trace) {
+  assert(gc_ntypes < GC_MAX_TYPES);
+  gc_types[gc_ntypes] = trace;
+  return gc_ntypes++;
+}
+
+void gc_add_root(void **root) {
+  if (heap->nroots == heap->roots_cap)
+    heap->roots = gc_grow_vector(heap->roots, &heap->roots_cap, sizeof(void **));
+  heap->roots[heap->nroots++] = root;
+}
+
+void gc_remove_root(void **root) {
+  for (size_t i = 0; i < heap->nroots; i++) {
+    if (heap->roots[i] == root) {
+      heap->roots[i] = heap->roots[--heap->nroots];
+      return;
+    }
+  }
+}
+
+GCObject *new_gc_object(size_t size) {
+  GCObject *obj;
+
+  if (size > GC_MAX_CLASS_SIZE) {
+    GCLarge *large = malloc(sizeof(GCLarge) + size);
+
+    if (large == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+
+    large->prev = NULL;
+    large->next = heap->large;
+    if (heap->large != NULL)
+      heap->large->prev = large;
+    heap->large = large;
+    obj = &large->object;
+    obj->sclass = GC_LARGE;
+  } else {
+    size_t sclass = gc_size_class(size);
+    obj = gc_slab_take(sclass);
+    obj->sclass = sclass;
+  }
+
+  memset(obj->memory, 0, size);
+  obj->magic = GC_MAGIC;
+  obj->flags = GC_LIVE | (heap->epoch ? GC_EPOCH : 0);
+  obj->type = GC_TYPE_RAW;
   obj->size = size;
   obj->refs = 0;
   heap->num_objects++;
+  heap->bytes_live += gc_footprint(obj);
+
+  if (heap->phase == GC_Idle) {
+    if (heap->nyoung == heap->young_cap)
+      heap->young =
+          gc_grow_vector(heap->young, &heap->young_cap, sizeof(GCObject *));
+    heap->young[heap->nyoung++] = obj;
+    heap->young_bytes += gc_footprint(obj);
+  } else {
+    obj->flags |= GC_OLD;
+    heap->debt += gc_footprint(obj);
+  }
+
+  return obj;
+}
+
+void *gc_alloc_typed(size_t size, uint8_t type) {
+  GCObject *obj = new_gc_object(size);
+  obj->type = type;
+  return obj->memory;
+}
+
+void *gc_alloc(size_t size) {
+  GCObject *obj = new_gc_object(size);
   return obj->memory;
 }
 
@@ -61,111 +465,295 @@ void *gc_realloc(void *memory, size_t new_size) {
   if (memory == NULL)
     return NULL;
 
-  GCObject *objects = heap->objects;
-  while (objects) {
-    if (objects->memory == memory) {
-      if (objects->size > new_size) {
-        fprintf(stderr, "Reallocation error: Wrong size\n");
-        exit(EXIT_FAILURE);
-      }
-
-      void *nptr = realloc(objects->memory, new_size);
-
-      if (nptr == NULL) {
-        fprintf(stderr, "Reallocation error\n");
-        exit(EXIT_FAILURE);
-      }
-
-      objects->memory = nptr;
-      objects->size = new_size;
+  GCObject *obj = gc_object_of(memory);
+  if (obj->size > new_size) {
+    fprintf(stderr, "Reallocation error: Wrong size\n");
+    exit(EXIT_FAILURE);
+  }
 
-      return objects->memory;
-    }
-    objects = objects->next;
+  if (obj->sclass != GC_LARGE && new_size <= gc_class_size(obj->sclass)) {
+    memset(&obj->memory[obj->size], 0, new_size - obj->size);
+    obj->size = new_size;
+    return memory;
   }
 
-  return NULL;
+  GCObject *nobj = new_gc_object(new_size);
+  memcpy(nobj->memory, obj->memory, obj->size);
+  nobj->refs = obj->refs;
+  nobj->type = obj->type;
+  if (heap->phase == GC_Mark && gc_types[nobj->type] != NULL) {
+    nobj->flags ^= GC_EPOCH;
+    gc_shade(nobj);
+  }
+  gc_release(obj);
+  return nobj->memory;
 }
 
 void *gc_incref(void *memory) {
   if (memory == NULL)
     return NULL;
 
-  GCObject *objects = heap->objects;
-  while (objects) {
-    if (objects->memory == memory) {
-      objects->refs++;
-      return objects->memory;
-    }
-    objects = objects->next;
-  }
+  GCObject *obj = gc_object_of(memory);
+  obj->refs++;
+  if (heap->phase == GC_Mark)
+    gc_shade(obj);
+  return memory;
 }
 
 void *gc_decref(void *memory) {
   if (memory == NULL)
     return NULL;
 
-  GCObject *objects = heap->objects;
-  while (objects) {
-    if (objects->memory == memory) {
-      objects->refs--;
-      return objects->memory;
-    }
-    objects = objects->next;
-  }
+  gc_object_of(memory)->refs--;
+  return memory;
 }
 
 void gc_free(void *memory) {
   if (memory == NULL)
     return;
 
-  GCObject *objects = heap->objects;
-  while (objects) {
-    if (objects->memory == memory) {
-      objects->marked = true;
-      free(objects->memory);
+  gc_release(gc_object_of(memory));
+}
+
+void gc_trace(void *memory) {
+  if (memory == NULL)
+    return;
+
+  gc_shade(gc_object_of(memory));
+}
+
+void gc_write_barrier(void *object, void *value) {
+  if (value == NULL)
+    return;
+
+  if (heap->phase == GC_Mark) {
+    gc_trace(value);
+    return;
+  }
+
+  if (heap->phase != GC_Idle || object == NULL)
+    return;
+
+  GCObject *owner = gc_object_of(object);
+  if ((owner->flags & (GC_OLD | GC_REMEMBERED)) != GC_OLD ||
+      (gc_object_of(value)->flags & GC_OLD))
+    return;
+
+  owner->flags |= GC_REMEMBERED;
+  if (heap->nremembered == heap->remembered_cap)
+    heap->remembered = gc_grow_vector(heap->remembered, &heap->remembered_cap,
+                                      sizeof(GCObject *));
+  heap->remembered[heap->nremembered++] = owner;
+}
+
+void gc_step(size_t work) {
+  while (work > 0) {
+    if (heap->phase == GC_Idle)
+      return;
+
+    if (heap->phase == GC_Mark) {
+      if (heap->ngrey > 0) {
+        GCObject *obj = heap->grey[--heap->ngrey];
+        if ((obj->flags & GC_LIVE) && obj->magic == GC_MAGIC &&
+            gc_types[obj->type])
+          gc_types[obj->type](obj->memory);
+        work--;
+        continue;
+      }
+
+      if (!heap->cursor.done) {
+        GCObject *obj = gc_cursor_next();
+        if (obj != NULL && (obj->flags & GC_LIVE) && obj->refs > 0)
+          gc_shade(obj);
+        work--;
+        continue;
+      }
+
+      gc_scan_roots();
+      if (heap->ngrey > 0)
+        continue;
+
+      heap->phase = GC_Sweep;
+      gc_cursor_reset();
+    }
+
+    GCObject *obj = gc_cursor_next();
+    if (obj == NULL) {
+      gc_finish_cycle();
       return;
     }
-    objects = objects->next;
+    if ((obj->flags & GC_LIVE) && !gc_is_marked(obj) && obj->refs == 0)
+      gc_release(obj);
+    work--;
   }
 }
 
-void gc_mark(void) {
-  GCObject *objects = heap->objects;
-  while (objects) {
-    if (objects->refs == 0 && objects->memory != NULL)
-      objects->marked = true;
-    objects = objects->next;
+void gc_safepoint(void) {
+  if (heap->phase == GC_Idle) {
+    if (heap->young_bytes >= GC_NURSERY_SIZE) {
+      uint64_t start = gc_clock();
+      gc_minor();
+      gc_record_pause(start);
+    }
+    if (heap->debt < heap->threshold)
+      return;
+    gc_start_cycle();
   }
+
+  uint64_t start = gc_clock();
+  gc_step(GC_STEP_WORK + heap->debt / GC_BYTES_PER_WORK);
+  heap->debt = 0;
+  gc_record_pause(start);
 }
 
-void gc_sweep(void) {
-  GCObject *objects = heap->objects;
-  while (objects) {
-    if (objects->marked && objects->memory != NULL) {
-      GCObject *to_free = objects;
-      objects = to_free->next;
-      free(to_free->memory);
-      free(to_free);
-    }
+void gc_mark(void) {
+  if (heap->phase == GC_Idle)
+    gc_start_cycle();
+  while (heap->phase == GC_Mark)
+    gc_step(GC_STEP_WORK);
+}
 
-    objects = objects->next;
-  }
+void gc_sweep(void) {
+  while (heap->phase == GC_Sweep)
+    gc_step(GC_STEP_WORK);
 }
 
 void gc_collect(void) {
+  uint64_t start = gc_clock();
+  if (heap->phase == GC_Sweep)
+    gc_sweep();
   gc_mark();
   gc_sweep();
+  gc_record_pause(start);
+}
+
+void gc_get_stats(GCStats *stats) {
+  *stats = heap->stats;
+  stats->live_objects = heap->num_objects;
+  stats->live_bytes = heap->bytes_live;
+  stats->total_pause_us = heap->total_pause_ns / 1000;
+  stats->max_pause_us = heap->max_pause_ns / 1000;
 }
 
 void gc_shutdown(void) {
-  gc_collect();
+  for (size_t sclass = 0; sclass < GC_NUM_CLASSES; sclass++) {
+    GCSlab *slab = heap->slabs[sclass];
+    while (slab) {
+      GCSlab *next = slab->next;
+      munmap(slab, DEFAULT_HEAP_SIZE);
+      slab = next;
+    }
+  }
+
+  GCLarge *large = heap->large;
+  while (large) {
+    GCLarge *next = large->next;
+    free(large);
+    large = next;
+  }
+
+  free(heap->roots);
+  free(heap->grey);
+  free(heap->young);
+  free(heap->remembered);
   free(heap);
 }
 
+size_t gc_num_objects(void) { return heap->num_objects; }
+
+static ArenaChunk *new_arena_chunk(size_t size) {
+  ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+
+  if (chunk == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+Arena *new_arena(size_t chunk_size) {
+  Arena *arena = malloc(sizeof(Arena));
+  arena->chunk_size = chunk_size;
+  arena->chunks = new_arena_chunk(chunk_size);
+  arena->last = NULL;
+  return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size_t aligned_size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+  ArenaChunk *chunk = arena->chunks;
+
+  if (chunk->used + aligned_size > chunk->size) {
+    size_t chunk_size = arena->chunk_size;
+    if (aligned_size > chunk_size)
+      chunk_size = aligned_size;
+    chunk = new_arena_chunk(chunk_size);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+  }
+
+  void *memory = &chunk->memory[chunk->used];
+  chunk->used += aligned_size;
+  arena->last = memory;
+  return memory;
+}
+
+void *arena_realloc(Arena *arena, void *memory, size_t old_size,
+                    size_t new_size) {
+  if (memory == NULL)
+    return arena_alloc(arena, new_size);
+
+  if (memory == arena->last) {
+    ArenaChunk *chunk = arena->chunks;
+    size_t offset = (uint8_t *)memory - chunk->memory;
+    size_t aligned_size =
+        (new_size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if (offset + aligned_size <= chunk->size) {
+      chunk->used = offset + aligned_size;
+      return memory;
+    }
+  }
+
+  void *nptr = arena_alloc(arena, new_size);
+  memcpy(nptr, memory, old_size < new_size ? old_size : new_size);
+  return nptr;
+}
+
+uint8_t *arena_strndup(Arena *arena, const uint8_t *str, size_t length) {
+  uint8_t *dup = arena_alloc(arena, length + 1);
+  memcpy(dup, str, length);
+  dup[length] = '\0';
+  return dup;
+}
+
+void arena_reset(Arena *arena) {
+  ArenaChunk *chunk = arena->chunks;
+  while (chunk->next != NULL) {
+    ArenaChunk *to_free = chunk;
+    chunk = chunk->next;
+    free(to_free);
+  }
+  chunk->used = 0;
+  arena->chunks = chunk;
+  arena->last = NULL;
+}
+
+void delete_arena(Arena *arena) {
+  ArenaChunk *chunk = arena->chunks;
+  while (chunk) {
+    ArenaChunk *to_free = chunk;
+    chunk = chunk->next;
+    free(to_free);
+  }
+  free(arena);
+}
+
 uint8_t *gc_strndup(const uint8_t *str, size_t length) {
   uint8_t *mem = (uint8_t *)gc_alloc(length + 1);
-  gc_incref(mem);
   uint8_t *dup = memmove(&mem[0], &str[0], length);
   return dup;
 }
@@ -3,18 +3,50 @@
 
 typedef struct GCObject GCObject;
 typedef struct GCHeap GCHeap;
+typedef struct Arena Arena;
+typedef void (*GCTraceFn)(void *memory);
 
+#define GC_TYPE_RAW 0
+
+typedef struct GCStats {
+  size_t minor_collections;
+  size_t major_collections;
+  size_t bytes_freed;
+  size_t live_objects;
+  size_t live_bytes;
+  size_t pauses;
+  uint64_t total_pause_us;
+  uint64_t max_pause_us;
+} GCStats;
+
+void gc_get_stats(GCStats *stats);
+size_t gc_num_objects(void);
+void delete_arena(Arena *arena);
+void arena_reset(Arena *arena);
+uint8_t *arena_strndup(Arena *arena, const uint8_t *str, size_t length);
+void *arena_realloc(Arena *arena, void *memory, size_t old_size,
+                    size_t new_size);
+void *arena_alloc(Arena *arena, size_t size);
+Arena *new_arena(size_t chunk_size);
 uint8_t *gc_strndup(const uint8_t *str, size_t length);
 void gc_shutdown(void);
 void gc_collect(void);
 void gc_sweep(void);
 void gc_mark(void);
+void gc_safepoint(void);
+void gc_step(size_t work);
+void gc_write_barrier(void *object, void *value);
+void gc_trace(void *memory);
 void gc_free(void *memory);
 void *gc_decref(void *memory);
 void *gc_incref(void *memory);
 void *gc_realloc(void *memory,size_t new_size);
 void *gc_alloc(size_t size);
-GCObject *new_gc_object(void);
+void *gc_alloc_typed(size_t size, uint8_t type);
+void gc_remove_root(void **root);
+void gc_add_root(void **root);
+uint8_t gc_register_type(GCTraceFn trace);
+GCObject *new_gc_object(size_t size);
 void gc_init(void);
 
 #endif
@@ -9,6 +9,10 @@
 #include "job.h"
 #include "lexer.h"
 #include "absyn.h"
+#include "bytecode.h"
+#include "flatast.h"
+#include "script.h"
+#include "pathexp.h"
 
 extern bool do_exit;
 
@@ -17,6 +21,13 @@ static size_t current_range = 0;
 void yyerror(const char *);
 
 void walk_tree(ASTList*);
+static void run_compound(ASTCompound*);
+static ASTWord *concat_words(ASTWord*, ASTWord*);
+static ASTArithExpr *arith_root(ASTFactor*);
+static ASTBuffer *assign_text(ASTBuffer*);
+static ASTWord *word_text(ASTBuffer*);
+static ASTPattern *glob_pattern(ASTBuffer*);
+static ASTPattern *case_text(ASTBuffer*);
 
 %}
 
@@ -24,11 +35,12 @@ void walk_tree(ASTList*);
 
 %union {
   int numval;
+  intmax_t integerval;
   char paramval;
-  char charval;
   ASTBuffer *bufferval;
   ASTParam *astparamval;
   ASTWordExpn *wordexpnval;
+  ASTFactor *factorval;
   ASTPattern *patternval;
   ASTRedir *redirval;
   ASTSimpleCommand *simplecmdval;
@@ -36,75 +48,143 @@ void walk_tree(ASTList*);
   ASTWord *wordval;
   ASTList *listval;
   ASTCompound *compoundval;
+  ASTCompoundList *compoundlistval;
   ASTCaseCond *casecondval;
   ASTIfCond *ifcondval;
   ASTUntilLoop *untilloopval;
   ASTForLoop *forloopval;
   ASTWhileLoop *whileloopval;
-  ASTCharRange *charrangeval;
-  ASTBracket *bracketval;
   ASTFuncDef *funcdefval;
 }
 
-%token BUFFER FNNAME_IDENTIFIER DOLLAR_IDENTIFIER EXPN_IDENTIFIER EXPN_WORD EXPN_PUNCT
-%token SEMI AMPR DISJ CONJ PIPE EQUAL
+%token BUFFER WORD ANCHORED_IDENTIFIER FNNAME_IDENTIFIER DOLLAR_IDENTIFIER EXPN_IDENTIFIER EXPN_WORD EXPN_PUNCT
+%token NEWLINE
+%token SEMI AMPR DISJ CONJ PIPE
 %token LANGLE RANGLE APPEND DUPIN DUPOUT NCLBR HERESTR HEREDOC
 %token DIGIT_REDIR
 %token SPECPARAM ARGNUM PARAM_IDENTIFIER
 %token EXPN_START EXPN_END
 %token KW_IF KW_ELSE KW_ELIF KW_THEN KW_FI
 %token KW_WHILE KW_FOR KW_UNTIL
-%token KW_CASE KW_ESAC
+%token KW_CASE KW_ESAC DSEMI
 %token KW_IN KW_DO KW_DONE
 %token FN_PARENS LPAREN RPAREN LCURLY RCURLY
-%token BRACK_START BRACK_END BRACK_CHAR BRACK_DASH BRACK_BANG
-%token TILDE BANG QMARK STAR 
-%token DOLLAR_LPAREN DOLLAR_RPARE
-%token TICK_START TICK_END STRING_START STRING_END QSTRING
+%token TILDE BANG
+%token DOLLAR_LPAREN DOLLAR_RPAREN
+%token TICK_START TICK_END STRING_START STRING_END STRING_BUFFER QSTRING
+%token CONCAT
+%token ARITH_START ARITH_END INTEGER
+%token PLUS MINUS TIMES DIV MODULO SHL SHR
 %token HEREDOC_DELIM HEREDOC_TEXT
 
 %type <cmdval> command
 %type <simplecmdval> simple_command
 %type <redirval> redir
-%type <wordval> word
+%type <wordval> word value value_part
+%type <wordexpnval> expansion string_parts string_part
+%type <astparamval> param expn_param
+%type <factorval> arith_expr arith_factor
 %type <pipelineval> pipeline
 %type <compoundval> compound_command
+%type <compoundlistval> compound_list
 %type <listval> list
-%type <charrangeval> char_range char_ranges
-%type <bracketval> bracket
-%type <patternval> pattern patterns
+%type <patternval> case_pattern case_part
 %type <funcdefval> func_def
-%type <casecondval> case_cond
-%type <ifcondval> if_cond
+%type <casecondval> case_cond case_head
+%type <ifcondval> if_cond if_clauses
 %type <untilloopval> until_loop
 %type <forloopval> for_loop
 %type <whileloopval> while_loop
 
-%type <bufferval> BUFFER QSTRING ANCHORED_IDENTIFIER FNNAME_IDENTIFIER PARAM_IDENTIFIER EXPN_IDENTIFIER EXPN_WORD EXPN_PUNCT HEREDOC_TEXT
-%type <numval> DIGIT_REDIR
-%type <charval> BRACK_CHAR
+%type <bufferval> for_items
+%type <bufferval> BUFFER WORD QSTRING STRING_BUFFER ANCHORED_IDENTIFIER FNNAME_IDENTIFIER PARAM_IDENTIFIER EXPN_IDENTIFIER EXPN_WORD EXPN_PUNCT HEREDOC_TEXT
+%type <numval> DIGIT_REDIR ARGNUM
+%type <paramval> SPECPARAM
+%type <integerval> INTEGER
+
+%left SHL SHR
+%left PLUS MINUS
+%left TIMES DIV MODULO
 
 %start squash
 
+/* Lists may follow one another without a separator, so bison cannot tell
+ * where a simple command ends: every token that can start a word, and the
+ * SEMI that closes a pipeline, conflicts with reducing the list early. The
+ * default shift is what we want: the word joins the current command and
+ * the SEMI terminates its pipeline. */
+%expect 45
+
 %%
 
 squash: %empty
-      | SEMI				{ }
-      | list				{ walk_tree($1); }
+      | squash SEMI			{ }
+      | squash NEWLINE			{ }
+      | squash list			{ if (getenv("SQUASH_DUMP_AST")) walk_tree($2); run_compound(new_ast_compound(COMPOUND_List, $2)); }
+      | squash compound_command		{ run_compound($2); }
       ;
 
-compound_command: list					{ $$ = new_ast_compound(COMPOUND_List, $1); }
-		| LPAREN compound_list RPAREN 		{ $$ = new_ast_compound(COMPOUND_Subshell, $2); }
-		| LCURLY compound_list SEMI RCURLY 	{ $$ = new_ast_compound(COMPOUND_Group, $2); }
-		| LCURLY compound_list NEWLINE RCURLY   { $$ = new_ast_compound(COMPOUND_Group, $2);  }
+compound_command: LPAREN compound_list RPAREN 		{ $$ = new_ast_compound(COMPOUND_Subshell, $2); }
+		| LCURLY compound_list RCURLY 		{ $$ = new_ast_compound(COMPOUND_Group, $2); }
+		| for_loop				{ $$ = new_ast_compound(COMPOUND_ForLoop, $1); }
+		| case_cond				{ $$ = new_ast_compound(COMPOUND_CaseCond, $1); }
+		| if_cond				{ $$ = new_ast_compound(COMPOUND_IfCond, $1); }
+		| while_loop				{ $$ = new_ast_compound(COMPOUND_WhileLoop, $1); }
+		| until_loop				{ $$ = new_ast_compound(COMPOUND_UntilLoop, $1); }
 		;
 
-compound_list: compound_list NEWLINE list	{ ast_list_append($1->lists, $2); $1->nlists++; }
-	     | list				{ $$ = new_ast_compound_list($1); }
+compound_list: linebreak list			{ $$ = new_ast_compound_list($2); }
+	     | compound_list NEWLINE		{ $$ = $1; }
+	     | compound_list list		{ ast_list_append($1->lists, $2); $1->nlists++; $$ = $1; }
 	     ;
 
-list: list DISJ pipeline		{ $3->sep = SEP_Or; ast_compound_append($1->commands, $3); }
-    | list CONJ pipeline		{ $3->sep = SEP_And; ast_compound_append($1->commands, $3); }
+linebreak: %empty
+	 | linebreak NEWLINE
+	 ;
+
+sequential_sep: SEMI linebreak
+	      | NEWLINE linebreak
+	      ;
+
+for_loop: KW_FOR WORD KW_IN for_items sequential_sep KW_DO compound_list KW_DONE	{ $$ = new_ast_forloop($2, $4, $7); }
+	;
+
+for_items: for_items WORD		{ ast_buffer_append($1, $2); $$ = $1; }
+	 | WORD				{ $$ = new_ast_buffer($1->buffer, $1->length); }
+	 ;
+
+while_loop: KW_WHILE compound_list KW_DO compound_list KW_DONE	{ $$ = new_ast_whileloop($2, $4); }
+	  ;
+
+until_loop: KW_UNTIL compound_list KW_DO compound_list KW_DONE	{ $$ = new_ast_untilloop($2, $4); }
+	  ;
+
+if_cond: if_clauses KW_FI				{ $$ = $1; }
+       | if_clauses KW_ELSE compound_list KW_FI		{ $1->else_body = $3; $$ = $1; }
+       ;
+
+if_clauses: KW_IF compound_list KW_THEN compound_list			{ $$ = new_ast_ifcond(); ast_ifcond_pair_append($$, $2, $4); }
+	  | if_clauses KW_ELIF compound_list KW_THEN compound_list	{ ast_ifcond_pair_append($1, $3, $5); $$ = $1; }
+	  ;
+
+case_cond: case_head KW_ESAC						{ $$ = $1; }
+	 | case_head case_pattern RPAREN compound_list KW_ESAC		{ ast_casecond_pair_append($1, $2, $4); $$ = $1; }
+	 ;
+
+case_head: KW_CASE word KW_IN linebreak						{ $$ = new_ast_casecond($2); }
+	 | case_head case_pattern RPAREN compound_list DSEMI linebreak		{ ast_casecond_pair_append($1, $2, $4); $$ = $1; }
+	 | case_head LPAREN case_pattern RPAREN compound_list DSEMI linebreak	{ ast_casecond_pair_append($1, $3, $5); $$ = $1; }
+	 ;
+
+case_pattern: case_pattern PIPE case_part	{ ast_pattern_alternate($1, $3); $$ = $1; }
+	    | case_part			{ $$ = $1; }
+	    ;
+
+case_part: WORD				{ $$ = case_text($1); }
+	 ;
+
+list: list DISJ pipeline		{ $3->sep = SEP_Or; ast_pipeline_append($1->commands, $3); $1->ncommands++; }
+    | list CONJ pipeline		{ $3->sep = SEP_And; ast_pipeline_append($1->commands, $3); $1->ncommands++; }
     | pipeline				{ $$ = new_ast_list($1); }
     ;
 
@@ -115,14 +195,71 @@ pipeline: pipeline SEMI			{ $1->term = TERM_Semi; }
 	;
 
 simple_command: simple_command word	{ ast_word_append($1->argv, $2); $1->nargs++; }
-     	      | word		{ $$ = new_ast_simple_command($1); }
+     	      | word		{ $$ = new_ast_simple_command(NULL, $1); }
 	      ;
 
-word: BUFFER		{ $$ = new_ast_word(WORD_Buffer, $1); }
+word: value		{ $$ = $1; }
     | redir		{ $$ = new_ast_word(WORD_Redir, $1); }
-    | patterns		{ $$ = new_ast_word(WORD_Pattern, $1; }
+    | ANCHORED_IDENTIFIER CONCAT value	{ $$ = new_ast_word(WORD_Assign, new_ast_assign($1, $3)); }
+    | ANCHORED_IDENTIFIER		{ $$ = new_ast_word(WORD_Assign, new_ast_assign($1, NULL)); }
     ;
 
+value: value_part			{ $$ = $1; }
+     | value CONCAT value_part		{ $$ = concat_words($1, $3); }
+     | value CONCAT ANCHORED_IDENTIFIER	{ $$ = concat_words($1, new_ast_word(WORD_Buffer, assign_text($3))); }
+     ;
+
+value_part: BUFFER					{ $$ = new_ast_word(WORD_Buffer, $1); }
+	  | WORD					{ $$ = word_text($1); }
+	  | QSTRING					{ $$ = new_ast_word(WORD_QString, $1); }
+	  | STRING_START STRING_END			{ $$ = new_ast_word(WORD_QString, new_ast_buffer_blank()); }
+	  | STRING_START string_parts STRING_END	{ $$ = new_ast_word(WORD_String, $2); }
+	  | expansion					{ $$ = new_ast_word(WORD_WordExpn, $1); }
+	  ;
+
+string_parts: string_parts string_part	{ ast_wordexpn_append($1, $2); $$ = $1; }
+	    | string_part		{ $$ = $1; }
+	    ;
+
+string_part: STRING_BUFFER		{ $$ = new_ast_wordexpn(WEXPN_Text, $1); }
+	   | expansion			{ $$ = $1; }
+	   ;
+
+expansion: param							{ $$ = new_ast_wordexpn(WEXPN_ParamExpn, new_ast_paramexpn($1, NULL, NULL)); }
+	 | EXPN_START expn_param EXPN_END				{ $$ = new_ast_wordexpn(WEXPN_ParamExpn, new_ast_paramexpn($2, NULL, NULL)); }
+	 | EXPN_START expn_param EXPN_PUNCT EXPN_END			{ $$ = new_ast_wordexpn(WEXPN_ParamExpn, new_ast_paramexpn($2, $3, NULL)); }
+	 | EXPN_START expn_param EXPN_PUNCT EXPN_WORD EXPN_END		{ $$ = new_ast_wordexpn(WEXPN_ParamExpn, new_ast_paramexpn($2, $3, new_ast_word(WORD_Buffer, $4))); }
+	 | DOLLAR_LPAREN compound_list DOLLAR_RPAREN			{ $$ = new_ast_wordexpn(WEXPN_CommandSubst, new_ast_compound(COMPOUND_Group, $2)); }
+	 | TICK_START compound_list TICK_END				{ $$ = new_ast_wordexpn(WEXPN_CommandSubst, new_ast_compound(COMPOUND_Group, $2)); }
+	 | ARITH_START arith_expr ARITH_END				{ $$ = new_ast_wordexpn(WEXPN_ArithExpr, arith_root($2)); }
+	 ;
+
+arith_expr: arith_expr PLUS arith_expr		{ $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Add, $1, $3)); }
+	  | arith_expr MINUS arith_expr		{ $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Sub, $1, $3)); }
+	  | arith_expr TIMES arith_expr		{ $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Mul, $1, $3)); }
+	  | arith_expr DIV arith_expr		{ $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Div, $1, $3)); }
+	  | arith_expr MODULO arith_expr	{ $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Mod, $1, $3)); }
+	  | arith_expr SHL arith_expr		{ $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Shl, $1, $3)); }
+	  | arith_expr SHR arith_expr		{ $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Shr, $1, $3)); }
+	  | arith_factor			{ $$ = $1; }
+	  ;
+
+arith_factor: INTEGER				{ $$ = new_ast_factor(FACT_Number, &$1); }
+	    | PARAM_IDENTIFIER			{ $$ = new_ast_factor(FACT_Variable, $1); }
+	    | MINUS arith_factor		{ intmax_t zero = 0; $$ = new_ast_factor(FACT_ArithExpr, new_ast_arithexpr(OP_Sub, new_ast_factor(FACT_Number, &zero), $2)); }
+	    | LPAREN arith_expr RPAREN		{ $$ = $2; }
+	    ;
+
+param: ARGNUM			{ $$ = new_ast_param(PARAM_Positional, &$1); }
+     | SPECPARAM		{ $$ = new_ast_param(PARAM_Special, &$1); }
+     | PARAM_IDENTIFIER		{ $$ = new_ast_param(PARAM_ShellVariable, $1); }
+     ;
+
+expn_param: ARGNUM		{ $$ = new_ast_param(PARAM_Positional, &$1); }
+	  | SPECPARAM		{ $$ = new_ast_param(PARAM_Special, &$1); }
+	  | EXPN_IDENTIFIER	{ $$ = new_ast_param(PARAM_ShellVariable, $1); }
+	  ;
+
 redir: DIGIT_REDIR LANGLE WORD				{ $$ = new_ast_redir(REDIR_Out, $3); $$->fno = $1; }
      | DIGIT_REDIR RANGLE WORD				{ $$ = new_ast_redir(REDIR_In, $3); $$->fno = $1; }
      | DIGIT_REDIR DUPIN WORD			        { $$ = new_ast_redir(REDIR_DupIn, $3); $$->fno = $1; }
@@ -141,56 +278,168 @@ redir: DIGIT_REDIR LANGLE WORD				{ $$ = new_ast_redir(REDIR_Out, $3); $$->fno =
      | DUPOUT WORD					{ $$ = new_ast_redir(REDIR_DupOut, $2);  }
      ;
 
-patterns: patterns pattern	{ ast_pattern_append($1, $2); $$ = $1; }
-	| pattern		{ $$ = $1; }
-	;
+%%
 
-pattern: STAR			{ $$ = new_ast_pattern(PATT_AnyString, NULL); }
-       | QMARK			{ $$ = new_ast_pattern(PATT_AnyChar, NULL); }
-       | bracket	        { $$ = new_ast_pattern(PATT_Bracket, $1); }
-       ;
+void yyerror(const char *msg) {
+  fprintf(stderr, "Parsing error occurred:\n");
+fprintf(stderr, "%s\n", msg);
+}
 
-bracket: BRACK_START BRACK_BANG char_ranges BRACK_END { $$ = new_ast_bracket($3, true); }
-       | BRACK_START char_ranges BRACK_END 	      { $$ = new_ast_bracket($2, false); }
-       ;
+static void run_compound(ASTCompound *compound) {
+  if (!collect_tree(compound))
+    execute_compound(compound);
+}
 
-char_ranges: char_ranges char_range	{ ast_charrange_append($1, $2); $$ = $1; }
-	   | char_range			{ $$ = $1; }
-	   ;
+static ASTArithExpr *arith_root(ASTFactor *factor) {
+  if (factor->kind == FACT_ArithExpr)
+    return factor->v_arithexpr;
 
-char_range: BRACK_CHAR BRACK_DASH BRACK_CHAR { $$ = new_ast_charrange($1, $3); }
+  intmax_t zero = 0;
+  return new_ast_arithexpr(OP_Add, factor, new_ast_factor(FACT_Number, &zero));
+}
 
-%%
+/* A "name=" that only continues a word is plain text again. */
+static ASTBuffer *assign_text(ASTBuffer *name) {
+  ASTBuffer *text = new_ast_buffer_blank();
+  ast_buffer_append_string(text, name->buffer, name->length);
+  ast_buffer_append_char(text, '=');
+  return text;
+}
 
-void yyerror(const char *msg) {
-  fprintf(stderr, "Parsing error occurred:\n");
-fprintf(stderr, "%s\n", msg);
+/* Unquoted text with glob characters becomes a pattern so it expands. */
+static ASTWord *word_text(ASTBuffer *text) {
+  if (has_glob_chars((const char *)text->buffer, text->length))
+    return new_ast_word(WORD_Pattern, glob_pattern(text));
+  return new_ast_word(WORD_Buffer, text);
+}
+
+static ASTPattern *case_text(ASTBuffer *text) {
+  if (has_glob_chars((const char *)text->buffer, text->length))
+    return glob_pattern(text);
+  return new_ast_pattern(PATT_Literal, text);
+}
+
+static ASTPattern *append_pattern(ASTPattern *head, ASTPattern *part) {
+  if (head == NULL)
+    return part;
+  ast_pattern_append(head, part);
+  return head;
 }
 
-void walk_simple_command(ASTSimpleCommand *cmd) {
-  ASTWord *tmp = cmd->argv;
-  while (tmp) {
-    if (tmp->kind == WORD_Buffer)
-      printf("%s\n---=\n", tmp->v_buffer->buffer);
-    else if (tmp->kind == WORD_Redir) {
-      printf("%s\n", tmp->v_redir->subj->buffer);
-      printf("%i\n---=\n", tmp->v_redir->fno);
+static ASTPattern *flush_literal(ASTPattern *head, ASTBuffer **literal) {
+  if (*literal == NULL)
+    return head;
+  head = append_pattern(head, new_ast_pattern(PATT_Literal, *literal));
+  *literal = NULL;
+  return head;
+}
+
+/* Parses the bracket expression after the '[' at TEXT[*POS]; returns NULL
+ * and leaves *POS alone when there is no closing ']'. */
+static ASTBracket *glob_bracket(ASTBuffer *text, size_t *pos) {
+  const uint8_t *buffer = text->buffer;
+  size_t i = *pos + 1;
+  bool negate = false;
+  ASTCharRange *ranges = NULL;
+
+  if (i < text->length && (buffer[i] == '!' || buffer[i] == '^')) {
+    negate = true;
+    i++;
+  }
+  for (size_t first = i; i < text->length; i++) {
+    if (buffer[i] == ']' && i > first)
+      break;
+    if (buffer[i] == '\\' && i + 1 < text->length)
+      i++;
+    uint8_t start = buffer[i], end = start;
+    if (i + 2 < text->length && buffer[i + 1] == '-' && buffer[i + 2] != ']') {
+      i += 2;
+      if (buffer[i] == '\\' && i + 1 < text->length)
+        i++;
+      end = buffer[i];
     }
-    tmp = tmp->next;
+    ASTCharRange *range = new_ast_charrange(start, end);
+    if (ranges == NULL)
+      ranges = range;
+    else
+      ast_charrange_append(ranges, range);
   }
+  if (i >= text->length)
+    return NULL;
+
+  *pos = i;
+  return new_ast_bracket(ranges, negate);
 }
 
-void walk_pipeline(ASTPipeline *pipeline) {
-  ASTSimpleCommand *simple_cmd = pipeline->commands;
-  while (simple_cmd) {
-     walk_simple_command(simple_cmd);
-     simple_cmd = simple_cmd->next;
+/* Splits TEXT into literal runs and '*', '?' and bracket patterns. */
+static ASTPattern *glob_pattern(ASTBuffer *text) {
+  ASTPattern *head = NULL;
+  ASTBuffer *literal = NULL;
+
+  for (size_t i = 0; i < text->length; i++) {
+    uint8_t ch = text->buffer[i];
+    ASTBracket *bracket;
+
+    if (ch == '*' || ch == '?') {
+      head = flush_literal(head, &literal);
+      head = append_pattern(head, new_ast_pattern(
+          ch == '*' ? PATT_AnyString : PATT_AnyChar, NULL));
+      continue;
+    }
+    if (ch == '[' && (bracket = glob_bracket(text, &i))) {
+      head = flush_literal(head, &literal);
+      head = append_pattern(head, new_ast_pattern(PATT_Bracket, bracket));
+      continue;
+    }
+    if (ch == '\\' && i + 1 < text->length)
+      ch = text->buffer[++i];
+    if (literal == NULL)
+      literal = new_ast_buffer_blank();
+    ast_buffer_append_char(literal, ch);
   }
+  return flush_literal(head, &literal);
+}
+
+static ASTWordExpn *word_parts(ASTWord *word) {
+  switch (word->kind) {
+  case WORD_WordExpn:
+  case WORD_String:
+    return word->v_wordexpn;
+  case WORD_Pattern:
+    return new_ast_wordexpn(WEXPN_Pattern, word->v_pattern);
+  default:
+    return new_ast_wordexpn(WEXPN_Text, word->v_buffer);
+  }
+}
+
+static ASTWord *concat_words(ASTWord *head, ASTWord *part) {
+  ASTWordExpn *parts = word_parts(head);
+  ast_wordexpn_append(parts, word_parts(part));
+  return new_ast_word(WORD_WordExpn, parts);
+}
+
+void walk_simple_command(FlatAST *ast, FlatCommand *cmd) {
+  FlatWord *words = &flat_words(ast)[cmd->words.first];
+  for (uint32_t i = 0; i < cmd->words.count; i++) {
+    printf("%s\n", flat_text(ast, words[i].text));
+    if (words[i].kind == WORD_Redir)
+      printf("%i\n", words[i].fno);
+    printf("---=\n");
+  }
+}
+
+void walk_pipeline(FlatAST *ast, FlatPipeline *pipeline) {
+  FlatCommand *cmds = &flat_commands(ast)[pipeline->commands.first];
+  for (uint32_t i = 0; i < pipeline->commands.count; i++)
+    walk_simple_command(ast, &cmds[i]);
 }
 
 void walk_tree(ASTList *list) {
-  ASTPipeline *pipeline = list->commands;
-  while (pipeline) {
+  FlatAST *ast = flatten_ast(list);
+  FlatPipeline *pipelines = flat_pipelines(ast);
+
+  for (uint32_t i = 0; i < ast->npipelines; i++) {
+    FlatPipeline *pipeline = &pipelines[i];
     if (pipeline->sep == SEP_And)
       printf("-And-\n");
     else if (pipeline->sep == SEP_Or)
@@ -199,7 +448,8 @@ void walk_tree(ASTList *list) {
       printf("-Semi-\n");
     else if (pipeline->term == TERM_Amper)
       printf("-Amper-\n");
-    walk_pipeline(pipeline);
-    pipeline = pipeline->next;
+    walk_pipeline(ast, pipeline);
   }
+
+  delete_flat_ast(ast);
 }
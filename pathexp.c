@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "globmatch.h"
+#include "pathexp.h"
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+enum {
+  ENTRY_Unknown = 0,
+  ENTRY_Directory = 4,
+  ENTRY_Link = 10,
+};
+
+typedef struct Component {
+  const char *text;
+  size_t length;
+  bool literal;
+  bool dot;
+  uint8_t *glob;
+} Component;
+
+typedef struct PathList {
+  char *bytes;
+  size_t nbytes;
+  size_t bytes_capacity;
+  size_t *offsets;
+  size_t count;
+  size_t capacity;
+} PathList;
+
+typedef struct ScanJob {
+  const PathList *dirs;
+  const Component *component;
+  bool need_dir;
+  atomic_size_t next;
+} ScanJob;
+
+typedef struct ScanWorker {
+  pthread_t thread;
+  bool started;
+  ScanJob *job;
+  PathList results;
+} ScanWorker;
+
+static void *pathexp_realloc(void *memory, size_t size) {
+  memory = realloc(memory, size);
+
+  if (memory == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return memory;
+}
+
+static void path_list_add(PathList *list, const char *dir, size_t dir_length,
+                          const char *name, size_t name_length) {
+  bool slash = dir_length && dir[dir_length - 1] != '/';
+  size_t length = dir_length + slash + name_length + 1;
+
+  if (list->nbytes + length > list->bytes_capacity) {
+    size_t capacity = list->bytes_capacity ? list->bytes_capacity : 4096;
+    while (capacity < list->nbytes + length)
+      capacity *= 2;
+    list->bytes = pathexp_realloc(list->bytes, capacity);
+    list->bytes_capacity = capacity;
+  }
+
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 64;
+    list->offsets =
+        pathexp_realloc(list->offsets, list->capacity * sizeof(size_t));
+  }
+
+  char *path = &list->bytes[list->nbytes];
+  memcpy(path, dir, dir_length);
+  if (slash)
+    path[dir_length] = '/';
+  memcpy(&path[dir_length + slash], name, name_length);
+  path[length - 1] = '\0';
+
+  list->offsets[list->count++] = list->nbytes;
+  list->nbytes += length;
+}
+
+static const char *path_list_get(const PathList *list, size_t i) {
+  return &list->bytes[list->offsets[i]];
+}
+
+static void free_path_list(PathList *list) {
+  free(list->bytes);
+  free(list->offsets);
+  *list = (PathList){0};
+}
+
+static void path_list_merge(PathList *list, PathList *other) {
+  if (list->count == 0) {
+    free_path_list(list);
+    *list = *other;
+    *other = (PathList){0};
+    return;
+  }
+
+  if (list->nbytes + other->nbytes > list->bytes_capacity) {
+    list->bytes_capacity = list->nbytes + other->nbytes;
+    list->bytes = pathexp_realloc(list->bytes, list->bytes_capacity);
+  }
+  if (list->count + other->count > list->capacity) {
+    list->capacity = list->count + other->count;
+    list->offsets =
+        pathexp_realloc(list->offsets, list->capacity * sizeof(size_t));
+  }
+
+  memcpy(&list->bytes[list->nbytes], other->bytes, other->nbytes);
+  for (size_t i = 0; i < other->count; i++)
+    list->offsets[list->count++] = list->nbytes + other->offsets[i];
+  list->nbytes += other->nbytes;
+  free_path_list(other);
+}
+
+bool has_glob_chars(const char *text, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '\\')
+      i++;
+    else if (text[i] == '*' || text[i] == '?' || text[i] == '[')
+      return true;
+  }
+  return false;
+}
+
+static size_t unescape(const char *text, size_t length, char *out) {
+  size_t n = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (text[i] == '\\' && i + 1 < length)
+      i++;
+    out[n++] = text[i];
+  }
+  return n;
+}
+
+void unescape_pattern(char *pattern) {
+  size_t length = unescape(pattern, strlen(pattern), pattern);
+  pattern[length] = '\0';
+}
+
+static bool is_directory(int dirfd, const struct linux_dirent64 *entry) {
+  struct stat st;
+
+  if (entry->d_type == ENTRY_Directory)
+    return true;
+  if (entry->d_type != ENTRY_Link && entry->d_type != ENTRY_Unknown)
+    return false;
+  return fstatat(dirfd, entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void scan_directory(const char *dir, const Component *component,
+                           bool need_dir, PathList *results, char *buffer) {
+  int fd = open(*dir ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  size_t dir_length = strlen(dir);
+
+  for (;;) {
+    long n = syscall(SYS_getdents64, fd, buffer, PATHEXP_BUFFER_SIZE);
+    if (n <= 0)
+      break;
+
+    for (long offset = 0; offset < n;) {
+      struct linux_dirent64 *entry = (struct linux_dirent64 *)&buffer[offset];
+      const char *name = entry->d_name;
+      offset += entry->d_reclen;
+
+      if (name[0] == '.' &&
+          (!component->dot || name[1] == '\0' ||
+           (name[1] == '.' && name[2] == '\0')))
+        continue;
+
+      size_t name_length = strlen(name);
+      if (!glob_match(component->glob, name, name_length))
+        continue;
+      if (need_dir && !is_directory(fd, entry))
+        continue;
+
+      path_list_add(results, dir, dir_length, name, name_length);
+    }
+  }
+
+  close(fd);
+}
+
+static void *scan_worker(void *arg) {
+  ScanWorker *worker = arg;
+  ScanJob *job = worker->job;
+  char *buffer = pathexp_realloc(NULL, PATHEXP_BUFFER_SIZE);
+
+  for (;;) {
+    size_t i = atomic_fetch_add(&job->next, 1);
+    if (i >= job->dirs->count)
+      break;
+    scan_directory(path_list_get(job->dirs, i), job->component, job->need_dir,
+                   &worker->results, buffer);
+  }
+
+  free(buffer);
+  return NULL;
+}
+
+static void scan_level(const PathList *dirs, const Component *component,
+                       bool need_dir, PathList *results) {
+  ScanWorker workers[PATHEXP_THREADS_MAX];
+  ScanJob job = {dirs, component, need_dir, 0};
+  size_t nthreads = 1;
+
+  /* Directories at one level are independent, so spread them across
+   * threads; each worker keeps its own getdents buffer and result list. */
+  if (dirs->count >= PATHEXP_PARALLEL_MIN) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = ncpu > 1 ? ncpu : 1;
+    if (nthreads > PATHEXP_THREADS_MAX)
+      nthreads = PATHEXP_THREADS_MAX;
+    if (nthreads > dirs->count)
+      nthreads = dirs->count;
+  }
+
+  for (size_t i = 0; i < nthreads; i++) {
+    workers[i] = (ScanWorker){.job = &job};
+    if (i > 0)
+      workers[i].started =
+          pthread_create(&workers[i].thread, NULL, scan_worker, &workers[i]) ==
+          0;
+  }
+
+  scan_worker(&workers[0]);
+
+  for (size_t i = 0; i < nthreads; i++) {
+    if (workers[i].started)
+      pthread_join(workers[i].thread, NULL);
+
+    path_list_merge(results, &workers[i].results);
+  }
+}
+
+static void expand_literal(const PathList *dirs, const Component *component,
+                           PathList *results) {
+  char *name = pathexp_realloc(NULL, component->length + 1);
+  size_t length = unescape(component->text, component->length, name);
+
+  for (size_t i = 0; i < dirs->count; i++) {
+    const char *dir = path_list_get(dirs, i);
+    path_list_add(results, dir, strlen(dir), name, length);
+  }
+
+  free(name);
+}
+
+static void filter_existing(PathList *paths, bool need_dir, PathList *results) {
+  for (size_t i = 0; i < paths->count; i++) {
+    const char *path = path_list_get(paths, i);
+    struct stat st;
+
+    if (need_dir ? stat(path, &st) == 0 && S_ISDIR(st.st_mode)
+                 : fstatat(AT_FDCWD, path, &st, AT_SYMLINK_NOFOLLOW) == 0)
+      path_list_add(results, "", 0, path, strlen(path));
+  }
+}
+
+static void insertion_sort(char **paths, size_t count, size_t depth) {
+  for (size_t i = 1; i < count; i++) {
+    char *path = paths[i];
+    size_t j = i;
+    while (j > 0 && strcmp(paths[j - 1] + depth, path + depth) > 0) {
+      paths[j] = paths[j - 1];
+      j--;
+    }
+    paths[j] = path;
+  }
+}
+
+static void radix_sort(char **paths, size_t count, size_t depth,
+                       char **scratch) {
+  while (count >= PATHEXP_RADIX_CUTOFF) {
+    size_t counts[256] = {0};
+
+    for (size_t i = 0; i < count; i++)
+      counts[(uint8_t)paths[i][depth]]++;
+
+    uint8_t first = paths[0][depth];
+    if (counts[first] == count) {
+      if (first == '\0')
+        return;
+      depth++;
+      continue;
+    }
+
+    size_t starts[256];
+    for (size_t c = 0, start = 0; c < 256; c++) {
+      starts[c] = start;
+      start += counts[c];
+    }
+
+    for (size_t i = 0; i < count; i++)
+      scratch[starts[(uint8_t)paths[i][depth]]++] = paths[i];
+    memcpy(paths, scratch, count * sizeof(char *));
+
+    for (size_t c = 1, start = counts[0]; c < 256; start += counts[c++])
+      if (counts[c] > 1)
+        radix_sort(&paths[start], counts[c], depth + 1, scratch);
+    return;
+  }
+
+  insertion_sort(paths, count, depth);
+}
+
+static size_t split_components(const char *pattern, Component *components,
+                               bool *want_dir) {
+  size_t ncomponents = 0;
+  const char *end = pattern + strlen(pattern);
+
+  *want_dir = end > pattern && end[-1] == '/';
+
+  for (const char *p = pattern; p < end;) {
+    while (p < end && *p == '/')
+      p++;
+    if (p == end)
+      break;
+
+    const char *start = p;
+    while (p < end && *p != '/') {
+      if (*p == '\\' && p + 1 < end)
+        p++;
+      p++;
+    }
+
+    Component *component = &components[ncomponents++];
+    component->text = start;
+    component->length = p - start;
+    component->literal = !has_glob_chars(start, p - start);
+    component->dot = start[0] == '.' || (start[0] == '\\' && start[1] == '.');
+    component->glob = NULL;
+  }
+
+  return ncomponents;
+}
+
+char **expand_pathname(const char *pattern, size_t *count) {
+  size_t length = strlen(pattern);
+  Component *components =
+      pathexp_realloc(NULL, (length / 2 + 1) * sizeof(Component));
+  bool want_dir;
+  size_t ncomponents = split_components(pattern, components, &want_dir);
+
+  PathList current = {0};
+  path_list_add(&current, "/", pattern[0] == '/', "", 0);
+
+  bool literal_tail = false;
+
+  for (size_t i = 0; i < ncomponents && current.count; i++) {
+    Component *component = &components[i];
+    bool last = i + 1 == ncomponents;
+    PathList next = {0};
+
+    if (component->literal) {
+      expand_literal(&current, component, &next);
+    } else {
+      size_t size;
+      component->glob = glob_compile(component->text, component->length, &size);
+      scan_level(&current, component, !last || want_dir, &next);
+      free(component->glob);
+    }
+
+    literal_tail = component->literal;
+    free_path_list(&current);
+    current = next;
+  }
+
+  free(components);
+
+  if (literal_tail) {
+    PathList existing = {0};
+    filter_existing(&current, want_dir, &existing);
+    free_path_list(&current);
+    current = existing;
+  }
+
+  if (current.count == 0) {
+    free_path_list(&current);
+    return NULL;
+  }
+
+  if (want_dir) {
+    PathList slashed = {0};
+    for (size_t i = 0; i < current.count; i++) {
+      const char *path = path_list_get(&current, i);
+      path_list_add(&slashed, path, strlen(path), "", 0);
+    }
+    free_path_list(&current);
+    current = slashed;
+  }
+
+  char **paths =
+      pathexp_realloc(NULL, current.count * sizeof(char *) + current.nbytes);
+  char *bytes = (char *)&paths[current.count];
+  memcpy(bytes, current.bytes, current.nbytes);
+  for (size_t i = 0; i < current.count; i++)
+    paths[i] = &bytes[current.offsets[i]];
+
+  char **scratch = pathexp_realloc(NULL, current.count * sizeof(char *));
+  radix_sort(paths, current.count, 0, scratch);
+  free(scratch);
+
+  *count = current.count;
+  free_path_list(&current);
+  return paths;
+}
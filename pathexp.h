@@ -0,0 +1,16 @@
+#ifndef PATHEXP_H
+#define PATHEXP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PATHEXP_BUFFER_SIZE (256 * 1024)
+#define PATHEXP_THREADS_MAX 8
+#define PATHEXP_PARALLEL_MIN 4
+#define PATHEXP_RADIX_CUTOFF 32
+
+bool has_glob_chars(const char *text, size_t length);
+char **expand_pathname(const char *pattern, size_t *count);
+void unescape_pattern(char *pattern);
+
+#endif
@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "absyn.h"
+#include "bytecode.h"
+#include "common.h"
+#include "lexer.h"
+#include "parser.tab.h"
+#include "script.h"
+#include "vars.h"
+
+#define FNV64_OFFSET_BASIS 14695981039346656037ull
+#define FNV64_PRIME 1099511628211ull
+#define SCRIPT_ALIGN(n)                                                        \
+  (((n) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+#define SCRIPT_SLACK 2
+#define SCRIPT_READ_SIZE (64 * 1024)
+
+typedef struct ScriptSource {
+  char *text;
+  size_t length;
+  size_t mapped;
+} ScriptSource;
+
+static ASTCompound *parsed_commands = NULL;
+static bool collecting = false;
+
+bool collect_tree(ASTCompound *compound) {
+  if (!collecting)
+    return false;
+
+  if (parsed_commands == NULL)
+    parsed_commands = compound;
+  else
+    ast_compound_append(parsed_commands, compound);
+  return true;
+}
+
+static bool read_source(int fd, ScriptSource *source) {
+  size_t capacity = SCRIPT_READ_SIZE;
+  char *text = malloc(capacity);
+
+  if (text == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t length = 0;
+  for (;;) {
+    if (capacity - length < SCRIPT_READ_SIZE + SCRIPT_SLACK) {
+      capacity *= 2;
+      text = realloc(text, capacity);
+
+      if (text == NULL) {
+        fprintf(stderr, "Allocation error\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    ssize_t n = read(fd, &text[length], SCRIPT_READ_SIZE);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      free(text);
+      return false;
+    }
+    if (n == 0)
+      break;
+    length += n;
+  }
+
+  memset(&text[length], 0, SCRIPT_SLACK);
+  source->text = text;
+  source->length = length;
+  source->mapped = 0;
+  return true;
+}
+
+static bool map_source(int fd, size_t length, ScriptSource *source) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t mapped = (length + SCRIPT_SLACK + page - 1) & ~(page - 1);
+
+  /* Flex wants two NULs past the text; reserve zero pages and lay the file
+   * over the front so the tail never reads past EOF. */
+  char *text = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (text == MAP_FAILED)
+    return false;
+
+  if (length && mmap(text, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(text, mapped);
+    return false;
+  }
+
+  source->text = text;
+  source->length = length;
+  source->mapped = mapped;
+  return true;
+}
+
+static bool open_source(const char *path, ScriptSource *source) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  bool loaded = false;
+
+  if (fstat(fd, &st) == 0) {
+    if (S_ISREG(st.st_mode))
+      loaded = map_source(fd, st.st_size, source);
+    else
+      loaded = read_source(fd, source);
+  }
+
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return loaded;
+}
+
+static void close_source(ScriptSource *source) {
+  if (source->mapped)
+    munmap(source->text, source->mapped);
+  else
+    free(source->text);
+  source->text = NULL;
+}
+
+static uint64_t hash_source(const char *text, size_t length) {
+  uint64_t hash = FNV64_OFFSET_BASIS;
+
+  for (const char *version = SQUASH_VERSION; *version; version++) {
+    hash ^= (uint8_t)*version;
+    hash *= FNV64_PRIME;
+  }
+  hash ^= BYTECODE_VERSION;
+  hash *= FNV64_PRIME;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)text[i];
+    hash *= FNV64_PRIME;
+  }
+
+  return hash;
+}
+
+static bool cache_directory(char *dir, size_t size) {
+  const char *base = vars_get("XDG_CACHE_HOME");
+  const char *home = vars_get("HOME");
+  int n;
+
+  if (base && *base)
+    n = snprintf(dir, size, "%s/squash", base);
+  else if (home && *home)
+    n = snprintf(dir, size, "%s/.cache/squash", home);
+  else
+    return false;
+
+  return n > 0 && (size_t)n < size;
+}
+
+static bool make_cache_directory(char *dir) {
+  if (mkdir(dir, 0700) == 0 || errno == EEXIST)
+    return true;
+  if (errno != ENOENT)
+    return false;
+
+  char *slash = strrchr(dir, '/');
+  if (slash == NULL || slash == dir)
+    return false;
+
+  *slash = '\0';
+  bool made = make_cache_directory(dir);
+  *slash = '/';
+  return made && (mkdir(dir, 0700) == 0 || errno == EEXIST);
+}
+
+static bool image_valid(const ScriptImage *image, size_t size, uint64_t hash,
+                        size_t length) {
+  if (size < sizeof(ScriptImage) ||
+      memcmp(image->magic, SCRIPT_IMAGE_MAGIC, sizeof(image->magic)) ||
+      strncmp(image->version, SQUASH_VERSION, sizeof(image->version)) ||
+      image->ninsns != INSN_Count || image->insn_size != sizeof(Instr) ||
+      image->hash != hash || image->source_length != length ||
+      image->program_offset != SCRIPT_ALIGN(sizeof(ScriptImage)) ||
+      image->program_offset > size ||
+      image->program_size > size - image->program_offset)
+    return false;
+
+  const Program *program =
+      (const Program *)((const char *)image + image->program_offset);
+  return verify_program(program, image->program_size);
+}
+
+static const Program *load_image(uint64_t hash, size_t length, void **base,
+                                 size_t *size) {
+  char dir[PATH_MAX], path[PATH_MAX];
+
+  if (!cache_directory(dir, sizeof(dir)) ||
+      snprintf(path, sizeof(path), "%s/%016" PRIx64, dir, hash) >=
+          (int)sizeof(path))
+    return NULL;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  void *image = MAP_FAILED;
+
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(ScriptImage))
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (image == MAP_FAILED)
+    return NULL;
+
+  if (!image_valid(image, st.st_size, hash, length)) {
+    munmap(image, st.st_size);
+    return NULL;
+  }
+
+  *base = image;
+  *size = st.st_size;
+  return (const Program *)((char *)image +
+                           ((ScriptImage *)image)->program_offset);
+}
+
+static void store_image(uint64_t hash, size_t length, const Program *program) {
+  char dir[PATH_MAX], path[PATH_MAX], temp[PATH_MAX];
+
+  if (!cache_directory(dir, sizeof(dir)) || !make_cache_directory(dir))
+    return;
+  if (snprintf(path, sizeof(path), "%s/%016" PRIx64, dir, hash) >=
+          (int)sizeof(path) ||
+      snprintf(temp, sizeof(temp), "%s/.%016" PRIx64 ".XXXXXX", dir, hash) >=
+          (int)sizeof(temp))
+    return;
+
+  int fd = mkstemp(temp);
+  if (fd < 0)
+    return;
+
+  ScriptImage image = {0};
+  memcpy(image.magic, SCRIPT_IMAGE_MAGIC, sizeof(image.magic));
+  strncpy(image.version, SQUASH_VERSION, sizeof(image.version));
+  image.ninsns = INSN_Count;
+  image.insn_size = sizeof(Instr);
+  image.hash = hash;
+  image.source_length = length;
+  image.program_offset = SCRIPT_ALIGN(sizeof(ScriptImage));
+  image.program_size = program->size;
+
+  static const char padding[_Alignof(max_align_t)];
+  struct iovec iov[] = {
+      {&image, sizeof(image)},
+      {(void *)padding, image.program_offset - sizeof(image)},
+      {(void *)program, program->size},
+  };
+  size_t total = image.program_offset + program->size;
+
+  bool written = writev(fd, iov, 3) == (ssize_t)total;
+  if (close(fd) < 0)
+    written = false;
+
+  /* Publish with rename so concurrent runs never map a partial image. */
+  if (!written || rename(temp, path) < 0)
+    unlink(temp);
+}
+
+static Program *compile_source(YY_BUFFER_STATE buffer) {
+  parsed_commands = NULL;
+  collecting = true;
+  int failed = yyparse();
+  collecting = false;
+  yy_delete_buffer(buffer);
+
+  Program *program = failed ? NULL : compile_compound(parsed_commands);
+  parsed_commands = NULL;
+  ast_arena_reset();
+  return program;
+}
+
+static int execute_program(const Program *program) {
+  if (vars_get("SQUASH_DUMP_BYTECODE"))
+    dump_program(program);
+  return run_program(program);
+}
+
+int run_script(const char *path) {
+  ScriptSource source;
+
+  if (!open_source(path, &source)) {
+    int status = errno == ENOENT ? 127 : 126;
+    fprintf(stderr, "squash: %s: %s\n", path, strerror(errno));
+    return status;
+  }
+
+  uint64_t hash = hash_source(source.text, source.length);
+  void *image;
+  size_t image_size;
+  const Program *cached = load_image(hash, source.length, &image, &image_size);
+
+  if (cached) {
+    close_source(&source);
+    int status = execute_program(cached);
+    munmap(image, image_size);
+    return status;
+  }
+
+  Program *program = compile_source(
+      yy_scan_buffer(source.text, source.length + SCRIPT_SLACK));
+
+  if (program)
+    store_image(hash, source.length, program);
+  close_source(&source);
+
+  if (program == NULL)
+    return 2;
+
+  int status = execute_program(program);
+  delete_program(program);
+  return status;
+}
+
+int run_command_string(const char *command) {
+  Program *program = compile_source(yy_scan_string(command));
+
+  if (program == NULL)
+    return 2;
+
+  int status = execute_program(program);
+  delete_program(program);
+  return status;
+}
@@ -0,0 +1,26 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "absyn.h"
+
+#define SCRIPT_IMAGE_MAGIC "SQSHIMG"
+
+typedef struct ScriptImage {
+  char magic[8];
+  char version[16];
+  uint32_t ninsns;
+  uint32_t insn_size;
+  uint64_t hash;
+  uint64_t source_length;
+  uint64_t program_offset;
+  uint64_t program_size;
+} ScriptImage;
+
+bool collect_tree(ASTCompound *compound);
+int run_script(const char *path);
+int run_command_string(const char *command);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "absyn.h"
+#include "builtin.h"
+#include "bytecode.h"
+#include "common.h"
+#include "job.h"
+#include "memory.h"
+#include "vars.h"
+
+/* The arms below only assign, so the job layer is never reached. */
+bool do_exit = false;
+bool interactive = false;
+pid_t last_background = 0;
+
+void reset_current_buffers(void) {}
+
+BuiltinFn find_builtin(const char *name) {
+  (void)name;
+  return NULL;
+}
+
+int launch_job(Command *cmds, bool background) {
+  (void)cmds;
+  (void)background;
+  abort();
+}
+
+int wait_status(int status) { return status; }
+
+int apply_redirects(Command *cmd) {
+  (void)cmd;
+  return 0;
+}
+
+void save_redirects(Command *cmd, int *saved) {
+  (void)cmd;
+  (void)saved;
+}
+
+void restore_redirects(Command *cmd, int *saved) {
+  (void)cmd;
+  (void)saved;
+}
+
+static ASTBuffer *text(const char *str) {
+  return new_ast_buffer((uint8_t *)str, strlen(str));
+}
+
+static ASTCompoundList *assign(const char *value) {
+  ASTWord *word = new_ast_word(
+      WORD_Assign, new_ast_assign(text("r"), new_ast_word(WORD_Buffer,
+                                                          text(value))));
+  return new_ast_compound_list(
+      new_ast_list(new_ast_pipeline(new_ast_simple_command(NULL, word))));
+}
+
+static ASTPattern *literal(const char *str) {
+  return new_ast_pattern(PATT_Literal, text(str));
+}
+
+static Program *compile_case_on_x(void) {
+  /* case $x in bar) r=bar;; foo) r=foo;; *) r=default;; esac */
+  ASTParam *param = new_ast_param(PARAM_ShellVariable, text("x"));
+  ASTWord *subject = new_ast_word(
+      WORD_WordExpn,
+      new_ast_wordexpn(WEXPN_ParamExpn, new_ast_paramexpn(param, NULL, NULL)));
+  ASTCaseCond *casecond = new_ast_casecond(subject);
+
+  ast_casecond_pair_append(casecond, literal("bar"), assign("bar"));
+  ast_casecond_pair_append(casecond, literal("foo"), assign("foo"));
+  ast_casecond_pair_append(casecond, new_ast_pattern(PATT_AnyString, NULL),
+                           assign("default"));
+
+  Program *program =
+      compile_compound(new_ast_compound(COMPOUND_CaseCond, casecond));
+  ast_arena_reset();
+  return program;
+}
+
+static bool dispatch(const Program *program, const char *x,
+                     const char *expected) {
+  vars_set("x", x, strlen(x));
+  run_program(program);
+
+  const char *r = vars_get("r");
+  if (r && !strcmp(r, expected))
+    return true;
+
+  fprintf(stderr, "case_dispatch: x=%s chose %s, expected %s\n", x,
+          r ? r : "nothing", expected);
+  return false;
+}
+
+/* Dropping the CaseSubject leaves the dispatch without a subject to read. */
+static bool rejects_unbalanced(Program *program) {
+  Instr *code = program_code(program);
+
+  for (uint32_t i = 0; i < program->ncode; i++) {
+    if (code[i].op != INSN_CaseSubject)
+      continue;
+    code[i] = code[i + 1];
+    if (!verify_program(program, program->size))
+      return true;
+    break;
+  }
+
+  fprintf(stderr, "case_dispatch: unbalanced case subject accepted\n");
+  return false;
+}
+
+int main(void) {
+  gc_init();
+
+  Program *program = compile_case_on_x();
+  bool ok = verify_program(program, program->size) &&
+            dispatch(program, "foo", "foo") &&
+            dispatch(program, "bar", "bar") &&
+            dispatch(program, "baz", "default") &&
+            dispatch(program, "$x", "default") && rejects_unbalanced(program);
+
+  delete_program(program);
+  if (!ok)
+    return EXIT_FAILURE;
+
+  printf("case_dispatch: ok\n");
+  return EXIT_SUCCESS;
+}
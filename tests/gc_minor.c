@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memory.h"
+
+#define NURSERY_FILL (512 * 1024)
+
+static void fill_nursery(void) {
+  for (size_t bytes = 0; bytes < NURSERY_FILL; bytes += 64)
+    gc_alloc(64);
+  gc_safepoint();
+}
+
+int main(void) {
+  gc_init();
+
+  /* Promote a raw owner, then barrier a young value into it. */
+  void **owner = gc_incref(gc_alloc(4 * sizeof(void *)));
+  fill_nursery();
+
+  GCStats stats;
+  gc_get_stats(&stats);
+  if (stats.minor_collections == 0) {
+    fprintf(stderr, "gc_minor: nursery never collected\n");
+    return EXIT_FAILURE;
+  }
+
+  owner[0] = gc_incref(gc_alloc(16));
+  gc_write_barrier(owner, owner[0]);
+  fill_nursery();
+
+  size_t before = stats.minor_collections;
+  gc_get_stats(&stats);
+  if (stats.minor_collections <= before) {
+    fprintf(stderr, "gc_minor: remembered raw owner was not scanned\n");
+    return EXIT_FAILURE;
+  }
+
+  gc_free(owner[0]);
+  gc_free(owner);
+  gc_shutdown();
+  printf("gc_minor: ok\n");
+  return EXIT_SUCCESS;
+}
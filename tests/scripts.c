@@ -0,0 +1,141 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Each script goes through the real scanner and parser via `squash -c`. */
+typedef struct ScriptCase {
+  const char *script;
+  const char *expected;
+} ScriptCase;
+
+#define CASE_ARMS                                                              \
+  "*.c) echo c;; foo*) echo foo;; bar|x.?) echo alt;; *) echo other;; esac"
+
+static const ScriptCase cases[] = {
+    {"echo $((1 + 2 * 3)) $(( (1 + 2) * 3 ))", "7 9\n"},
+    {"echo $((7 % 4))x $((1 << 4)) $((-3 + 1)) $(((2)))", "3x 16 -2 2\n"},
+    {"echo 'a \"$x\" b' \"c 'd' e\"", "a \"$x\" b c 'd' e\n"},
+    {"echo \"x\\\"y\\\\z\\$w\\q\" a\"b\"c'd'", "x\"y\\z$w\\q abcd\n"},
+    {"echo one\n"
+     "echo two\n"
+     "if false\n"
+     "then\n"
+     "  echo no\n"
+     "else\n"
+     "  echo three\n"
+     "fi\n"
+     "for i in 1 2; do\n"
+     "  echo \"item $i\"\n"
+     "done\n",
+     "one\ntwo\nthree\nitem 1\nitem 2\n"},
+    {"x=1; echo $x", "1\n"},
+    {"A=1 env | grep '^A='; echo \"after:$A.\"", "A=1\nafter:.\n"},
+    {"y= echo hi; echo \"[$y]\" a=b --opt=v", "hi\n[] a=b --opt=v\n"},
+    {"case a.c in " CASE_ARMS "\n"
+     "case foo.h in " CASE_ARMS "\n"
+     "case bar in " CASE_ARMS "\n"
+     "case x.y in " CASE_ARMS "\n"
+     "case zz in " CASE_ARMS "\n"
+     "case x.y in *.c|x.?) echo glob;; esac",
+     "c\nfoo\nalt\nalt\nother\nglob\n"},
+    {"echo dir/*.ext dir/[ab]*.e?t \"dir/*\".ext dir/*.none",
+     "dir/a.ext dir/b.ext dir/a.ext dir/b.ext dir/*.ext dir/*.none\n"},
+};
+
+static bool run_case(const char *shell, const ScriptCase *test) {
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    return false;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execl(shell, shell, "-c", test->script, (char *)NULL);
+    perror(shell);
+    _exit(127);
+  }
+
+  close(fds[1]);
+  char output[4096];
+  size_t length = 0;
+  ssize_t nread;
+  while (length < sizeof(output) - 1 &&
+         (nread = read(fds[0], &output[length], sizeof(output) - 1 - length)) >
+             0)
+    length += nread;
+  output[length] = '\0';
+  close(fds[0]);
+  waitpid(pid, NULL, 0);
+
+  if (!strcmp(output, test->expected))
+    return true;
+
+  fprintf(stderr, "scripts: %s\n  expected: %s  got: %s\n", test->script,
+          test->expected, output);
+  return false;
+}
+
+/* Cases run inside a scratch directory holding dir/{a,b}.ext and dir/c.c. */
+static bool make_fixture(char *root) {
+  static const char *const files[] = {"dir/a.ext", "dir/b.ext", "dir/c.c"};
+
+  if (mkdtemp(root) == NULL || chdir(root) < 0 || mkdir("dir", 0755) < 0) {
+    perror(root);
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+    int fd = open(files[i], O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) {
+      perror(files[i]);
+      return false;
+    }
+    close(fd);
+  }
+  return true;
+}
+
+static void remove_fixture(const char *root) {
+  unlink("dir/a.ext");
+  unlink("dir/b.ext");
+  unlink("dir/c.c");
+  rmdir("dir");
+  chdir("/");
+  rmdir(root);
+}
+
+int main(int argc, char **argv) {
+  char shell[PATH_MAX];
+  char root[] = "/tmp/squash-scripts.XXXXXX";
+  bool ok = true;
+
+  if (realpath(argc > 1 ? argv[1] : "./squash", shell) == NULL) {
+    perror("realpath");
+    return EXIT_FAILURE;
+  }
+  if (!make_fixture(root))
+    return EXIT_FAILURE;
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++)
+    ok &= run_case(shell, &cases[i]);
+  remove_fixture(root);
+
+  if (!ok)
+    return EXIT_FAILURE;
+
+  printf("scripts: ok\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,339 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vars.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+extern char **environ;
+
+static struct VarTable {
+  Variable *slots;
+  size_t capacity;
+  size_t count;
+} var_table = {NULL, 0, 0};
+
+static struct VarFrames {
+  VarUndo *undo;
+  size_t nundo;
+  size_t undo_capacity;
+  size_t *marks;
+  size_t nmarks;
+  size_t marks_capacity;
+} var_frames = {NULL, 0, 0, NULL, 0, 0};
+
+static char **envp = NULL;
+static bool env_dirty = true;
+
+static void *vars_grow(void *memory, size_t *capacity, size_t needed,
+                       size_t size) {
+  if (needed <= *capacity)
+    return memory;
+
+  size_t new_capacity = *capacity ? *capacity : 16;
+  while (new_capacity < needed)
+    new_capacity *= 2;
+
+  memory = realloc(memory, new_capacity * size);
+
+  if (memory == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  *capacity = new_capacity;
+  return memory;
+}
+
+static uint32_t hash_name(const char *name, size_t length) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)name[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static void var_table_grow(void) {
+  size_t capacity =
+      var_table.capacity ? var_table.capacity * 2 : VARS_INITIAL_SIZE;
+  Variable *slots = calloc(capacity, sizeof(Variable));
+
+  if (slots == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < var_table.capacity; i++) {
+    Variable *var = &var_table.slots[i];
+    if (var->name == NULL)
+      continue;
+    size_t slot = var->hash & (capacity - 1);
+    while (slots[slot].name != NULL)
+      slot = (slot + 1) & (capacity - 1);
+    slots[slot] = *var;
+  }
+
+  free(var_table.slots);
+  var_table.slots = slots;
+  var_table.capacity = capacity;
+}
+
+static void store_value(Variable *var, const char *value, size_t length) {
+  /* Reuse the buffer in place; counters never reallocate once sized. */
+  if (length + 1 > var->capacity) {
+    size_t capacity = var->capacity ? var->capacity : VARS_VALUE_MIN;
+    while (capacity < length + 1)
+      capacity *= 2;
+
+    char *buffer = realloc(var->value, capacity);
+
+    if (buffer == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+
+    var->value = buffer;
+    var->capacity = capacity;
+  }
+
+  memmove(var->value, value, length);
+  var->value[length] = '\0';
+  var->length = length;
+  var->flags |= VAR_Set;
+  if (var->flags & VAR_Exported)
+    env_dirty = true;
+}
+
+static Variable *find_slot(const char *name, size_t length, uint32_t hash) {
+  size_t mask = var_table.capacity - 1;
+  size_t slot = hash & mask;
+  Variable *var;
+
+  while ((var = &var_table.slots[slot])->name != NULL) {
+    if (var->hash == hash && var->name_length == length &&
+        !memcmp(var->name, name, length))
+      return var;
+    slot = (slot + 1) & mask;
+  }
+
+  return var;
+}
+
+static Variable *intern_variable(const char *name, size_t length) {
+  if ((var_table.count + 1) * 10 > var_table.capacity * 7)
+    var_table_grow();
+
+  uint32_t hash = hash_name(name, length);
+  Variable *var = find_slot(name, length, hash);
+
+  if (var->name == NULL) {
+    var->name = malloc(length + 1);
+
+    if (var->name == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+
+    memcpy(var->name, name, length);
+    var->name[length] = '\0';
+    var->name_length = length;
+    var->hash = hash;
+    var_table.count++;
+  }
+
+  return var;
+}
+
+static void import_environ(void) {
+  var_table_grow();
+
+  for (char **env = environ; env && *env; env++) {
+    const char *equals = strchr(*env, '=');
+    if (equals == NULL || equals == *env)
+      continue;
+
+    Variable *var = intern_variable(*env, equals - *env);
+    var->flags |= VAR_Exported;
+    store_value(var, equals + 1, strlen(equals + 1));
+  }
+}
+
+static Variable *lookup_variable(const char *name) {
+  if (var_table.capacity == 0)
+    import_environ();
+
+  size_t length = strlen(name);
+  Variable *var = find_slot(name, length, hash_name(name, length));
+  return var->name ? var : NULL;
+}
+
+static Variable *define_variable(const char *name) {
+  if (var_table.capacity == 0)
+    import_environ();
+  return intern_variable(name, strlen(name));
+}
+
+const char *vars_get(const char *name) {
+  Variable *var = lookup_variable(name);
+  return var && var->flags & VAR_Set ? var->value : NULL;
+}
+
+void vars_set(const char *name, const char *value, size_t length) {
+  store_value(define_variable(name), value, length);
+}
+
+void vars_unset(const char *name) {
+  Variable *var = lookup_variable(name);
+  if (var == NULL)
+    return;
+
+  /* Names stay interned and keep their buffer for the next assignment. */
+  if (var->flags & VAR_Exported && var->flags & VAR_Set)
+    env_dirty = true;
+  var->flags = 0;
+  var->length = 0;
+}
+
+void vars_export(const char *name) {
+  Variable *var = define_variable(name);
+  if (!(var->flags & VAR_Exported) && var->flags & VAR_Set)
+    env_dirty = true;
+  var->flags |= VAR_Exported;
+}
+
+void vars_declare_local(const char *name) {
+  if (var_frames.nmarks == 0)
+    return;
+
+  Variable *var = define_variable(name);
+  size_t mark = var_frames.marks[var_frames.nmarks - 1];
+
+  for (size_t i = mark; i < var_frames.nundo; i++)
+    if (var_frames.undo[i].name == var->name)
+      return;
+
+  var_frames.undo = vars_grow(var_frames.undo, &var_frames.undo_capacity,
+                              var_frames.nundo + 1, sizeof(VarUndo));
+  var_frames.undo[var_frames.nundo++] = (VarUndo){
+      var->name, var->hash, var->value, var->length, var->capacity,
+      var->flags};
+
+  /* The outer value moves to the undo stack; nothing is copied. */
+  if (var->flags & VAR_Exported && var->flags & VAR_Set)
+    env_dirty = true;
+  var->value = NULL;
+  var->length = 0;
+  var->capacity = 0;
+  var->flags = 0;
+}
+
+void vars_push_frame(void) {
+  var_frames.marks = vars_grow(var_frames.marks, &var_frames.marks_capacity,
+                               var_frames.nmarks + 1, sizeof(size_t));
+  var_frames.marks[var_frames.nmarks++] = var_frames.nundo;
+}
+
+void vars_pop_frame(void) {
+  if (var_frames.nmarks == 0)
+    return;
+
+  size_t mark = var_frames.marks[--var_frames.nmarks];
+
+  while (var_frames.nundo > mark) {
+    VarUndo *undo = &var_frames.undo[--var_frames.nundo];
+    Variable *var = find_slot(undo->name, strlen(undo->name), undo->hash);
+
+    if ((var->flags | undo->flags) & VAR_Exported)
+      env_dirty = true;
+    free(var->value);
+    var->value = undo->value;
+    var->length = undo->length;
+    var->capacity = undo->capacity;
+    var->flags = undo->flags;
+  }
+}
+
+char **vars_environ(void) {
+  if (var_table.capacity == 0)
+    import_environ();
+  if (!env_dirty)
+    return envp;
+
+  size_t count = 0;
+  size_t bytes = 0;
+
+  for (size_t i = 0; i < var_table.capacity; i++) {
+    Variable *var = &var_table.slots[i];
+    if (var->name && (var->flags & (VAR_Set | VAR_Exported)) ==
+                         (VAR_Set | VAR_Exported)) {
+      count++;
+      bytes += var->name_length + var->length + 2;
+    }
+  }
+
+  /* One block holds the pointer array followed by the strings. */
+  char **block = malloc((count + 1) * sizeof(char *) + bytes);
+
+  if (block == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  char *text = (char *)&block[count + 1];
+  size_t n = 0;
+
+  for (size_t i = 0; i < var_table.capacity; i++) {
+    Variable *var = &var_table.slots[i];
+    if (var->name == NULL || (var->flags & (VAR_Set | VAR_Exported)) !=
+                                 (VAR_Set | VAR_Exported))
+      continue;
+
+    block[n++] = text;
+    memcpy(text, var->name, var->name_length);
+    text += var->name_length;
+    *text++ = '=';
+    memcpy(text, var->value, var->length + 1);
+    text += var->length + 1;
+  }
+  block[n] = NULL;
+
+  free(envp);
+  envp = block;
+  env_dirty = false;
+  return envp;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp((*(const Variable **)a)->name, (*(const Variable **)b)->name);
+}
+
+void vars_print(bool exported_only) {
+  if (var_table.capacity == 0)
+    import_environ();
+
+  Variable **sorted = malloc(var_table.count * sizeof(Variable *));
+
+  if (sorted == NULL && var_table.count) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < var_table.capacity; i++) {
+    Variable *var = &var_table.slots[i];
+    if (var->name && var->flags & VAR_Set &&
+        (!exported_only || var->flags & VAR_Exported))
+      sorted[n++] = var;
+  }
+
+  qsort(sorted, n, sizeof(Variable *), compare_names);
+  for (size_t i = 0; i < n; i++)
+    printf("%s%s=%s\n", exported_only ? "export " : "", sorted[i]->name,
+           sorted[i]->value);
+  free(sorted);
+}
@@ -0,0 +1,43 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VARS_INITIAL_SIZE 256
+#define VARS_VALUE_MIN 16
+
+#define VAR_Set 0x01
+#define VAR_Exported 0x02
+
+typedef struct Variable {
+  char *name;
+  char *value;
+  uint32_t hash;
+  uint32_t name_length;
+  size_t length;
+  size_t capacity;
+  uint8_t flags;
+} Variable;
+
+typedef struct VarUndo {
+  const char *name;
+  uint32_t hash;
+  char *value;
+  size_t length;
+  size_t capacity;
+  uint8_t flags;
+} VarUndo;
+
+const char *vars_get(const char *name);
+void vars_set(const char *name, const char *value, size_t length);
+void vars_unset(const char *name);
+void vars_export(const char *name);
+void vars_declare_local(const char *name);
+void vars_push_frame(void);
+void vars_pop_frame(void);
+char **vars_environ(void);
+void vars_print(bool exported_only);
+
+#endif
@@ -0,0 +1,735 @@
+#include <pwd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <wait.h>
+
+#include "absyn.h"
+#include "arith.h"
+#include "builtin.h"
+#include "bytecode.h"
+#include "common.h"
+#include "globmatch.h"
+#include "job.h"
+#include "memory.h"
+#include "pathexp.h"
+#include "vars.h"
+
+#define VM_ARENA_CHUNK_SIZE (16 * 1024)
+#define VM_NEST_MAX 64
+
+typedef struct LoopFrame {
+  const char *name;
+  char **items;
+  size_t nitems;
+  size_t capacity;
+  size_t next;
+} LoopFrame;
+
+static Command stages[PIPELINE_MAX];
+static int nstages = 0;
+static bool stages_overflow = false;
+
+static Arena *scratch = NULL;
+static char *expansion = NULL;
+static size_t expansion_length = 0;
+static size_t expansion_capacity = 0;
+
+static LoopFrame loops[VM_NEST_MAX];
+static int nloops = 0;
+static char *subjects[VM_NEST_MAX];
+static int nsubjects = 0;
+
+static int last_status = 0;
+
+static char **positional = NULL;
+static int npositional = 0;
+
+static size_t *field_breaks = NULL;
+static size_t nfield_breaks = 0;
+static size_t field_breaks_capacity = 0;
+static bool empty_fields = false;
+
+extern bool do_exit;
+extern bool interactive;
+extern pid_t last_background;
+
+static char *vm_strdup(const char *str) {
+  char *copy = strdup(str);
+
+  if (copy == NULL) {
+    fprintf(stderr, "Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return copy;
+}
+
+static void loop_add_item(LoopFrame *frame, const char *item) {
+  if (frame->nitems == frame->capacity) {
+    frame->capacity = frame->capacity ? frame->capacity * 2 : 8;
+    frame->items = realloc(frame->items, frame->capacity * sizeof(char *));
+
+    if (frame->items == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  frame->items[frame->nitems++] = vm_strdup(item);
+}
+
+static void reset_stage(Command *stage) {
+  if (stage->argv == NULL) {
+    stage->argv = malloc(ARGV_MAX * sizeof(char *));
+
+    if (stage->argv == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+
+    stage->argv_capacity = ARGV_MAX;
+  }
+
+  stage->argc = 0;
+  stage->argv[0] = NULL;
+  stage->nredirs = 0;
+  stage->nassigns = 0;
+  stage->assigns_capacity = 0;
+  stage->assigns = NULL;
+  stage->envp = NULL;
+  stage->next = NULL;
+  stage->tail = stage;
+}
+
+static void reset_pipeline(void) {
+  reset_stage(&stages[0]);
+  nstages = 1;
+  stages_overflow = false;
+}
+
+static void append_arg(Command *stage, const char *arg) {
+  if (stage->argc + 1 >= stage->argv_capacity) {
+    stage->argv_capacity *= 2;
+    stage->argv =
+        realloc(stage->argv, stage->argv_capacity * sizeof(char *));
+
+    if (stage->argv == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  stage->argv[stage->argc++] = arg;
+  stage->argv[stage->argc] = NULL;
+}
+
+static void expand_arg(Command *stage, char *pattern) {
+  size_t count;
+  char **paths = expand_pathname(pattern, &count);
+
+  if (paths == NULL) {
+    unescape_pattern(pattern);
+    append_arg(stage, pattern);
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    append_arg(stage, (const char *)arena_strndup(scratch, (uint8_t *)paths[i],
+                                                  strlen(paths[i])));
+  free(paths);
+}
+
+static void append_assign(Command *stage, const char *name,
+                          const char *value) {
+  size_t name_length = strlen(name);
+  size_t value_length = strlen(value);
+  char *pair = arena_alloc(scratch, name_length + value_length + 2);
+
+  memcpy(pair, name, name_length);
+  pair[name_length] = '=';
+  memcpy(&pair[name_length + 1], value, value_length + 1);
+
+  if (stage->nassigns == stage->assigns_capacity) {
+    int capacity = stage->assigns_capacity ? stage->assigns_capacity * 2 : 8;
+    stage->assigns = arena_realloc(scratch, stage->assigns,
+                                   stage->assigns_capacity * sizeof(char *),
+                                   capacity * sizeof(char *));
+    stage->assigns_capacity = capacity;
+  }
+
+  stage->assigns[stage->nassigns++] = pair;
+}
+
+static bool same_name(const char *a, const char *b) {
+  while (*a == *b && *a != '=' && *a != '\0') {
+    a++;
+    b++;
+  }
+  return *a == '=' && *b == '=';
+}
+
+static bool assign_shadowed(Command *stage, int from, const char *pair) {
+  for (int i = from; i < stage->nassigns; i++)
+    if (same_name(stage->assigns[i], pair))
+      return true;
+  return false;
+}
+
+static void build_stage_environ(Command *stage) {
+  char **base = vars_environ();
+  size_t nbase = 0;
+
+  while (base[nbase])
+    nbase++;
+
+  /* The inherited strings stay in the variable store's block; nothing
+   * rebuilds it before the pipeline has been spawned. */
+  char **envp =
+      arena_alloc(scratch, (nbase + stage->nassigns + 1) * sizeof(char *));
+  size_t n = 0;
+
+  for (size_t i = 0; i < nbase; i++)
+    if (!assign_shadowed(stage, 0, base[i]))
+      envp[n++] = base[i];
+  for (int i = 0; i < stage->nassigns; i++)
+    if (!assign_shadowed(stage, i + 1, stage->assigns[i]))
+      envp[n++] = (char *)stage->assigns[i];
+  envp[n] = NULL;
+  stage->envp = envp;
+}
+
+static void append_field(Command *stage, char *field, bool glob) {
+  if (glob)
+    expand_arg(stage, field);
+  else
+    append_arg(stage, field);
+}
+
+static void expansion_append(const char *text, size_t length) {
+  if (expansion_length + length + 1 > expansion_capacity) {
+    size_t capacity = expansion_capacity ? expansion_capacity : 256;
+    while (capacity < expansion_length + length + 1)
+      capacity *= 2;
+
+    expansion = realloc(expansion, capacity);
+
+    if (expansion == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+
+    expansion_capacity = capacity;
+  }
+
+  memcpy(&expansion[expansion_length], text, length);
+  expansion_length += length;
+}
+
+static void field_break(void) {
+  if (nfield_breaks == field_breaks_capacity) {
+    field_breaks_capacity = field_breaks_capacity ? field_breaks_capacity * 2
+                                                  : 16;
+    field_breaks =
+        realloc(field_breaks, field_breaks_capacity * sizeof(size_t));
+
+    if (field_breaks == NULL) {
+      fprintf(stderr, "Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  field_breaks[nfield_breaks++] = expansion_length;
+  expansion_append(" ", 1);
+}
+
+static bool expand_param(const Program *program, const Instr *instr,
+                         int status) {
+  char number[32];
+  const char *value = NULL;
+
+  switch (instr->flags) {
+  case PARAM_ShellVariable:
+    value = vars_get(program_text(program, instr->arg));
+    break;
+  case PARAM_Special:
+    switch (instr->fno) {
+    case '?':
+      snprintf(number, sizeof(number), "%d", status);
+      value = number;
+      break;
+    case '$':
+      snprintf(number, sizeof(number), "%d", getpid());
+      value = number;
+      break;
+    case '#':
+      snprintf(number, sizeof(number), "%d",
+               npositional > 0 ? npositional - 1 : 0);
+      value = number;
+      break;
+    case '!':
+      if (last_background) {
+        snprintf(number, sizeof(number), "%d", last_background);
+        value = number;
+      }
+      break;
+    case '-':
+      value = interactive ? "i" : "";
+      break;
+    case '0':
+      value = npositional > 0 ? positional[0] : "";
+      break;
+    case '@':
+    case '*':
+      /* Each parameter becomes its own field when the word is an argument;
+       * elsewhere the fields stay joined by a space. */
+      empty_fields = npositional <= 1;
+      for (int i = 1; i < npositional; i++) {
+        if (i > 1)
+          field_break();
+        expansion_append(positional[i], strlen(positional[i]));
+      }
+      return true;
+    default:
+      fprintf(stderr, "squash: $%c: unsupported expansion\n", instr->fno);
+      return false;
+    }
+    break;
+  case PARAM_Positional:
+    if (instr->fno >= 0 && instr->fno < npositional)
+      value = positional[instr->fno];
+    break;
+  }
+
+  if (value)
+    expansion_append(value, strlen(value));
+  return true;
+}
+
+static void expand_number(intmax_t value) {
+  char number[24];
+  char *p = &number[sizeof(number)];
+  uintmax_t magnitude = value < 0 ? 0 - (uintmax_t)value : (uintmax_t)value;
+
+  do
+    *--p = '0' + magnitude % 10;
+  while (magnitude /= 10);
+  if (value < 0)
+    *--p = '-';
+
+  expansion_append(p, &number[sizeof(number)] - p);
+}
+
+static void expand_tilde(const char *user) {
+  const char *home = NULL;
+
+  if (*user == '\0') {
+    home = vars_get("HOME");
+  } else {
+    struct passwd *pw = getpwnam(user);
+    if (pw)
+      home = pw->pw_dir;
+  }
+
+  if (home) {
+    expansion_append(home, strlen(home));
+  } else {
+    expansion_append("~", 1);
+    expansion_append(user, strlen(user));
+  }
+}
+
+static const CaseSlot *case_lookup(const Program *program,
+                                   const CaseTable *table, const char *subject,
+                                   size_t length) {
+  const CaseSlot *slots = case_slots(table);
+  uint32_t hash = case_hash(subject, length);
+  uint32_t mask = table->nslots - 1;
+
+  for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+    const CaseSlot *slot = &slots[i];
+    if (slot->key == CASE_EMPTY)
+      return NULL;
+    if (slot->hash == hash && slot->length == length &&
+        !memcmp(program_text(program, slot->key), subject, length))
+      return slot;
+  }
+}
+
+static int run_builtin(BuiltinFn fn, Command *cmd) {
+  int saved[REDIR_MAX];
+  int status = 1;
+
+  /* A builtin runs in the shell, so its prefix assignments go in a frame
+   * that is dropped as soon as it returns. */
+  if (cmd->nassigns)
+    vars_push_frame();
+  for (int i = 0; i < cmd->nassigns; i++) {
+    const char *pair = cmd->assigns[i];
+    const char *equals = strchr(pair, '=');
+    const char *name = (const char *)arena_strndup(
+        scratch, (const uint8_t *)pair, equals - pair);
+
+    vars_declare_local(name);
+    vars_export(name);
+    vars_set(name, equals + 1, strlen(equals + 1));
+  }
+
+  fflush(stdout);
+  save_redirects(cmd, saved);
+
+  if (apply_redirects(cmd) == 0)
+    status = fn(cmd->argc, (char **)cmd->argv);
+
+  fflush(stdout);
+  fflush(stderr);
+  restore_redirects(cmd, saved);
+
+  if (cmd->nassigns)
+    vars_pop_frame();
+  return status;
+}
+
+static int spawn_pipeline(bool background) {
+  Command *head = &stages[0];
+
+  if (stages_overflow) {
+    fprintf(stderr, "squash: pipeline longer than %d commands\n",
+            PIPELINE_MAX);
+    return 1;
+  }
+
+  if (head->argc == 0)
+    return 0;
+
+  if (nstages == 1 && !background) {
+    BuiltinFn fn = find_builtin(head->argv[0]);
+    if (fn)
+      return run_builtin(fn, head);
+  }
+
+  for (Command *stage = head; stage; stage = stage->next)
+    if (stage->nassigns)
+      build_stage_environ(stage);
+
+  return launch_job(head, background);
+}
+
+int run_program(const Program *program) {
+  static void *dispatch[INSN_Count] = {
+      [INSN_Halt] = &&op_halt,
+      [INSN_Load] = &&op_load,
+      [INSN_Begin] = &&op_begin,
+      [INSN_AppendText] = &&op_append_text,
+      [INSN_AppendParam] = &&op_append_param,
+      [INSN_AppendTilde] = &&op_append_tilde,
+      [INSN_AppendArith] = &&op_append_arith,
+      [INSN_End] = &&op_end,
+      [INSN_Arg] = &&op_arg,
+      [INSN_Assign] = &&op_assign,
+      [INSN_Redirect] = &&op_redirect,
+      [INSN_Pipe] = &&op_pipe,
+      [INSN_Spawn] = &&op_spawn,
+      [INSN_Jump] = &&op_jump,
+      [INSN_JumpIf] = &&op_jump_if,
+      [INSN_ForInit] = &&op_for_init,
+      [INSN_ForItem] = &&op_for_item,
+      [INSN_ForNext] = &&op_for_next,
+      [INSN_CaseSubject] = &&op_case_subject,
+      [INSN_CaseMatch] = &&op_case_match,
+      [INSN_CaseDispatch] = &&op_case_dispatch,
+      [INSN_CaseEnd] = &&op_case_end,
+      [INSN_Subshell] = &&op_subshell,
+      [INSN_Exit] = &&op_exit,
+  };
+
+#define DISPATCH() goto *dispatch[ip->op]
+#define NEXT()                                                                 \
+  do {                                                                         \
+    ip++;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+#define JUMP(target)                                                           \
+  do {                                                                         \
+    ip = &code[(target)];                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+
+  const Instr *code = program_code(program);
+  const Instr *ip = code;
+  const char *word = "";
+  bool glob_word = false;
+  int status = last_status;
+  bool success = status == 0;
+  bool subshell = false;
+  int loop_base = nloops;
+  int subject_base = nsubjects;
+
+  if (scratch == NULL)
+    scratch = new_arena(VM_ARENA_CHUNK_SIZE);
+  reset_pipeline();
+
+  DISPATCH();
+
+op_load:
+  word = program_text(program, ip->arg);
+  glob_word = false;
+  nfield_breaks = 0;
+  empty_fields = false;
+  NEXT();
+
+op_begin:
+  expansion_length = 0;
+  nfield_breaks = 0;
+  empty_fields = false;
+  NEXT();
+
+op_append_text: {
+  const char *text = program_text(program, ip->arg);
+  expansion_append(text, strlen(text));
+  NEXT();
+}
+
+op_append_param:
+  if (!expand_param(program, ip, status)) {
+    status = 1;
+    success = false;
+    goto op_halt;
+  }
+  NEXT();
+
+op_append_tilde:
+  expand_tilde(program_text(program, ip->arg));
+  NEXT();
+
+op_append_arith: {
+  intmax_t value;
+  if (!arith_eval((const ArithProgram *)program_text(program, ip->arg),
+                  vars_get, &value)) {
+    status = 1;
+    success = false;
+    goto op_halt;
+  }
+  expand_number(value);
+  NEXT();
+}
+
+op_end:
+  word = (const char *)arena_strndup(scratch, (uint8_t *)expansion,
+                                     expansion_length);
+  glob_word = ip->flags & END_Glob;
+  NEXT();
+
+op_arg: {
+  Command *stage = &stages[nstages - 1];
+  char *field = (char *)word;
+
+  if (empty_fields && *word == '\0')
+    NEXT();
+  /* After End the word is a scratch copy, so fields split in place. */
+  for (size_t i = 0; i < nfield_breaks; i++) {
+    char *end = (char *)word + field_breaks[i];
+    *end = '\0';
+    append_field(stage, field, glob_word);
+    field = end + 1;
+  }
+  append_field(stage, field, glob_word);
+  NEXT();
+}
+
+op_assign: {
+  const char *name = program_text(program, ip->arg);
+  if (glob_word)
+    unescape_pattern((char *)word);
+  if (ip->flags & ASSIGN_Local)
+    append_assign(&stages[nstages - 1], name, word);
+  else
+    vars_set(name, word, strlen(word));
+  NEXT();
+}
+
+op_redirect: {
+  Command *stage = &stages[nstages - 1];
+  if (stage->nredirs < REDIR_MAX)
+    stage->redirs[stage->nredirs++] =
+        (Redirect){ip->flags, ip->fno, word, strlen(word)};
+  NEXT();
+}
+
+op_pipe:
+  if (nstages == PIPELINE_MAX) {
+    stages_overflow = true;
+    NEXT();
+  }
+  reset_stage(&stages[nstages]);
+  stages[nstages - 1].next = &stages[nstages];
+  stages[0].tail = &stages[nstages];
+  nstages++;
+  NEXT();
+
+op_spawn:
+  status = spawn_pipeline(ip->flags & SPAWN_Background);
+  success = status == 0;
+  reset_pipeline();
+  arena_reset(scratch);
+  /* Scripts and -c never return to the prompt loop, so advance the
+   * collector between pipelines here. */
+  gc_safepoint();
+  if (do_exit)
+    goto op_halt;
+  NEXT();
+
+op_jump:
+  JUMP(ip->arg);
+
+op_jump_if:
+  if (success == (ip->flags == JUMP_IfSuccess))
+    JUMP(ip->arg);
+  NEXT();
+
+op_for_init:
+  if (nloops == VM_NEST_MAX) {
+    fprintf(stderr, "squash: loops nested too deeply\n");
+    status = 1;
+    goto op_halt;
+  }
+  loops[nloops++] = (LoopFrame){program_text(program, ip->arg), NULL, 0, 0, 0};
+  NEXT();
+
+op_for_item: {
+  LoopFrame *frame = &loops[nloops - 1];
+  char *field = (char *)word;
+
+  if (empty_fields && *word == '\0')
+    NEXT();
+  for (size_t i = 0; i < nfield_breaks; i++) {
+    char *end = (char *)word + field_breaks[i];
+    *end = '\0';
+    loop_add_item(frame, field);
+    field = end + 1;
+  }
+  loop_add_item(frame, field);
+  NEXT();
+}
+
+op_for_next: {
+  LoopFrame *frame = &loops[nloops - 1];
+  if (frame->next < frame->nitems) {
+    const char *item = frame->items[frame->next++];
+    vars_set(frame->name, item, strlen(item));
+    NEXT();
+  }
+  for (size_t i = 0; i < frame->nitems; i++)
+    free(frame->items[i]);
+  free(frame->items);
+  nloops--;
+  JUMP(ip->arg);
+}
+
+op_case_subject:
+  if (nsubjects == VM_NEST_MAX) {
+    fprintf(stderr, "squash: case nested too deeply\n");
+    status = 1;
+    goto op_halt;
+  }
+  if (glob_word)
+    unescape_pattern((char *)word);
+  subjects[nsubjects++] = vm_strdup(word);
+  NEXT();
+
+op_case_match: {
+  const char *subject = subjects[nsubjects - 1];
+  success = glob_match((const uint8_t *)program_text(program, ip->arg),
+                       subject, strlen(subject));
+  NEXT();
+}
+
+op_case_dispatch: {
+  const CaseTable *table = (const CaseTable *)program_text(program, ip->arg);
+  const char *subject = subjects[nsubjects - 1];
+  size_t length = strlen(subject);
+  const CaseSlot *hit = case_lookup(program, table, subject, length);
+  const CaseGlob *globs = case_globs(table);
+  uint32_t limit = hit ? hit->arm : UINT32_MAX;
+
+  /* Only glob arms written before the literal hit can still take
+   * precedence over it. */
+  for (uint32_t i = 0; i < table->nglobs && globs[i].arm < limit; i++)
+    if (glob_match((const uint8_t *)program_text(program, globs[i].glob),
+                   subject, length))
+      JUMP(globs[i].target);
+
+  JUMP(hit ? hit->target : table->default_target);
+}
+
+op_case_end:
+  free(subjects[--nsubjects]);
+  NEXT();
+
+op_subshell: {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    subshell = true;
+    NEXT();
+  }
+  if (pid < 0) {
+    perror("fork");
+    status = 1;
+  } else {
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    status = wait_status(wstatus);
+  }
+  success = status == 0;
+  JUMP(ip->arg);
+}
+
+op_exit:
+  fflush(stdout);
+  exit(status);
+
+op_halt:
+  /* An early exit inside ( ... ) must not fall back into the parent's
+   * caller from the forked child. */
+  if (subshell) {
+    fflush(stdout);
+    exit(status);
+  }
+  while (nloops > loop_base) {
+    LoopFrame *frame = &loops[--nloops];
+    for (size_t i = 0; i < frame->nitems; i++)
+      free(frame->items[i]);
+    free(frame->items);
+  }
+  while (nsubjects > subject_base)
+    free(subjects[--nsubjects]);
+
+  reset_pipeline();
+  arena_reset(scratch);
+  last_status = status;
+  return status;
+
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+}
+
+void set_positional_params(int argc, char **argv) {
+  positional = argv;
+  npositional = argc;
+}
+
+int execute_compound(ASTCompound *compound) {
+  Program *program = compile_compound(compound);
+
+  if (vars_get("SQUASH_DUMP_BYTECODE"))
+    dump_program(program);
+
+  int status = run_program(program);
+  delete_program(program);
+  return status;
+}